@@ -16,6 +16,7 @@
 #include <destral/destral_renderer.h>
 #include <destral/destral_texture.h>
 #include <destral/destral_sprite.h>
+#include <destral/destral_tilemap.h>
 
 #include <destral/destral_input.h>
 
@@ -58,6 +58,50 @@ namespace ds {
         // the on_ecs_config callback is executed after the engine is fully initialized and before the main loop
         // Here is where you will configure your components, entities and systems queues.
         void (*on_ecs_config)(registry* r) = nullptr;
+
+        // the on_world_config callback is executed for each world created with app_world_create
+        // Here is where you will configure the components, entities and game systems queues of the world.
+        void (*on_world_config)(registry* r) = nullptr;
+
+        // number of worker threads used to simulate the worlds (the main thread also simulates worlds)
+        // 0 means one worker for each hardware thread except the main thread
+        i32 world_worker_threads = 0;
+
+        // runs without window and GPU (servers, CI, benchmarks): the platform backend doesn't create a window and the
+        // renderer does all the CPU work (vertex generation, sorting, batching and frame stats) but doesn't use the GPU
+        bool headless = false;
+
+        // draws the frames in a dedicated render thread: render_present hands the sorted frame to the render thread
+        // (it uploads, draws and swaps the buffers) while the next frame is simulated. See render_gpu_acquire.
+        bool render_thread = false;
+
+        // depth buffer mode: the opaque sprites (see render_sprite) are drawn first, front to back, writing their depth
+        // and the rest of the primitives are drawn back to front testing it, so the hidden pixels are rejected early
+        // (less overdraw in dense layered scenes). Without it all the primitives are blended back to front.
+        bool depth_opaque_pass = false;
+
+        // fixed virtual resolution in pixels (pixel art games): the cameras render to an offscreen image of this size
+        // that is upscaled to the window at the end of the frame. 0,0 renders the cameras directly to the window.
+        i32 virtual_width = 0;
+        i32 virtual_height = 0;
+
+        // upscale the virtual resolution by the biggest integer factor that fits in the window (sharp pixels, black
+        // borders), if false it is scaled to fit the window keeping the aspect ratio (letterbox)
+        bool virtual_integer_scale = true;
+
+        // dynamic resolution: the cameras render to an offscreen image with the window size multiplied by a scale that
+        // is adjusted every few frames to keep the GPU time of the frames under the target, and it is upscaled to the window.
+        // The GPU time is measured with timer queries (see render_frame_stats::gpu_miliseconds), the vsync wait and the
+        // CPU work are not included. It is ignored in headless mode.
+        // The scale goes from dynamic_resolution_min_scale to 1. It is ignored with a virtual resolution.
+        bool dynamic_resolution = false;
+        float dynamic_resolution_target_miliseconds = 1000.0f / 60.0f;
+        float dynamic_resolution_min_scale = 0.5f;
+
+        // GPU resource budget: max retained render layers alive at the same time (see render_layer_create, each one
+        // owns up to 4 GPU buffers) and max GPU images (textures not packed in the atlas, atlas pages and render targets)
+        i32 max_render_layers = 256;
+        i32 max_gpu_images = 512;
 	};
 
 	bool app_run(const app_config& params);
@@ -72,6 +116,22 @@ namespace ds {
     // returns the application registry global
     registry* app_registry();
 
+    // Worlds are independent registries (rooms, instances, matches...) simulated in parallel on worker threads.
+    // Each world runs its game queues: [game::init] when created, [game::update] and [game::fixed_update]
+    // every frame after the app registry ones and [game::deinit] when destroyed.
+    // Engine queues (and rendering) are only executed by the app registry.
+    // IMPORTANT: World systems can only access their own registry (the one passed to the system), app_registry() is not thread safe.
+    // Use registry::entity_migrate to move entities between worlds (or the app registry).
+    // 
+    // Creates a world configured with app_config::on_world_config. Must be called from the app registry systems (main thread).
+    registry* app_world_create();
+
+    // Destroys a world created with app_world_create. Must be called from the app registry systems (main thread).
+    void app_world_destroy(registry* world);
+
+    // Returns the alive worlds
+    ds::darray<registry*> app_worlds();
+
     // get the current fixed tick delta time.
     // IMPORTANT: use app_dt when fetching the dt from a ecs system
     float app_fixed_dt();
@@ -0,0 +1,46 @@
+#pragma once
+#include <destral/destral_common.h>
+#include <destral/destral_math.h>
+#include <destral/thirdparty/sokol_gfx.h>
+
+namespace ds {
+	// Runtime texture atlas
+	// Small textures are packed with a shelf packer into shared RGBA8 atlas pages, so the sprites that use different
+	// textures share the same GPU image and can be merged in the same draw call.
+	// The pages are kept in CPU memory and uploaded to the GPU at render_present when they change.
+
+	// Size in pixels of the atlas pages
+	constexpr i32 ATLAS_PAGE_SIZE = 2048;
+
+	// Textures bigger than this (in any dimension) are not packed, they keep their own GPU image
+	constexpr i32 ATLAS_MAX_TEXTURE_SIZE = 512;
+
+	// Pixels around each packed texture filled with its border pixels (avoids sampling the neighbour textures)
+	constexpr i32 ATLAS_PADDING = 1;
+
+	// Location of a packed texture inside an atlas page
+	struct atlas_region {
+		sg_image page = { .id = 0 };
+		rect uv_rect; // normalized coordinates of the texture inside the page
+
+		// packing slot (used by atlas_remove)
+		i32 page_idx = -1;
+		i32 shelf_idx = -1;
+		i32 x = 0; // column of the padded rect in the shelf
+		i32 width = 0; // padded width
+	};
+
+	// Packs the RGBA8 pixels (rows from the bottom, like the textures uploaded to the GPU) in an atlas page.
+	// Returns false if the texture is too big to be packed.
+	bool atlas_add(const u8* pixels, ivec2 size, atlas_region* out_region);
+
+	// Releases the space of a packed texture, it can be reused by the next atlas_add.
+	// When all the textures of a page are removed the page is emptied (the GPU image is kept for new textures).
+	void atlas_remove(const atlas_region& region);
+
+	// Uploads the modified atlas pages to the GPU (called by render_present before drawing)
+	void atlas_flush();
+
+	// Destroys all the atlas pages (called by render_deinit)
+	void atlas_deinit();
+}
@@ -130,10 +130,12 @@ namespace ds::log {
 
 namespace ds {
 	using i8 = int8_t;
+	using i16 = int16_t;
 	using i32 = int32_t;
 	using i64 = int64_t;
 
 	using u8 = uint8_t;
+	using u16 = uint16_t;
 
 	// Don't use this 
 	using u32 = uint32_t;
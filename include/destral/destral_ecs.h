@@ -81,6 +81,17 @@
             IMPORTANT: UB if used on an entity not created using the entity_make_begin.
             IMPORTANT: UB if called multiple times on the same entity.
 
+        * using entity_reserve() and entity_make_reserved();
+            entity_reserve() is lock free and can be called from any thread. It hands out a unique entity handle
+            (recycled id or a brand new id) WITHOUT constructing anything, so parallel systems can spawn entities
+            and reference the handles immediately.
+            entity_make_reserved() constructs the components of a reserved handle and calls the init function.
+            Until then the handle is NOT valid (entity_valid returns false).
+            entity_release_reserved() gives back a reserved handle that will never be made, the id is recycled.
+            A reserved handle keeps its id until it is made or released.
+            IMPORTANT: entity_make_reserved and entity_release_reserved must be called from the main thread.
+            IMPORTANT: UB if you reserve entities while the main thread is creating or destroying entities.
+
     
     The creation of an entity internally looks like this:
 
@@ -136,9 +147,29 @@
             2 -> remove the component memory from the storage.
         }
     Step 3: Destroy the entity from the registry.
+
+
+    ////////// Multiple registries:
+    Registries are fully independent, you can create as many as you want (rooms, instances, matches...) and run
+    their system queues from different threads as long as each registry is only used by one thread at a time.
+    Entities can be moved from one registry to another using entity_migrate (see the function for the details).
 */
 #include <destral/destral_common.h>
 #include <destral/destral_containers.h>
+#include <source_location>
+#include <type_traits>
+
+/*--------------------------------------------------------------------------------
+    DS_ECS_VIEW_PROFILING   If true, views record per call site iteration statistics
+                            (entities visited, accepted, storages probed and time spent). See registry::view_stats_get
+--------------------------------------------------------------------------------*/
+#ifndef DS_ECS_VIEW_PROFILING
+#if DS_BUILD_DEBUG
+#define DS_ECS_VIEW_PROFILING 1
+#else
+#define DS_ECS_VIEW_PROFILING 0
+#endif
+#endif
 
 namespace ds {
 struct registry;
@@ -237,6 +268,13 @@ struct view {
 
     // Advances the next entity that has all the components for the view
     void next();
+
+    // Returns the position of the current entity in the iterated storage. Use it with seek to resume an iteration later.
+    inline i32 cursor() { return _impl.entity_index; }
+
+    // Moves the view to the first entity that has all the components starting at the iterated storage position (see cursor)
+    // If the storage changed since the cursor was retrieved some entities can be skipped or visited twice.
+    void seek(i32 cursor);
     
     // implementation details
     struct view_impl {
@@ -245,6 +283,10 @@ struct view {
         i32 entity_index = 0;
         i32 entity_max_index = 0; // it's like _impl.iterating_storage->dense.size() 
         ds::entity cur_entity = entity_null;
+#if DS_ECS_VIEW_PROFILING
+        struct view_profile* profile = nullptr;
+        double profile_start = -1; // view_create time, -1 once the iteration time is recorded
+#endif
     };
     // implementation details
     view_impl _impl;
@@ -265,15 +307,24 @@ struct registry {
     typedef void (component_cleanup_fn)(registry* r, entity e, void* cp);
     typedef void (component_placementnew_fn)(void* cp);
     typedef void (component_delete_fn)(void* cp);
+    typedef void (component_move_fn)(void* dst_cp, void* src_cp); // move constructs src_cp into the uninitialized dst_cp memory
     void component_register(const char* cp_name, i32 cp_sizeof,
         component_serialize_fn* srlz_fn = nullptr, component_cleanup_fn* cleanup_fn = nullptr,
-        component_placementnew_fn* placementnew_fn = nullptr, component_delete_fn* delete_fn = nullptr);
+        component_placementnew_fn* placementnew_fn = nullptr, component_delete_fn* delete_fn = nullptr,
+        component_move_fn* move_fn = nullptr);
 
     template <typename T> 
     void component_register(const char* cp_name, component_serialize_fn* cp_srlz_fn = nullptr, component_cleanup_fn* cp_cleanup_fn = nullptr) {
         component_placementnew_fn* cp_placementnew_fn = [](void* cp) { new (cp) T(); }; // Calls T constructor.
         component_delete_fn* cp_delete_fn = [](void* cp) { ((T*)cp)->~T(); }; // Calls T destructor
-        component_register(cp_name, (i32)sizeof(T), cp_srlz_fn, cp_cleanup_fn, cp_placementnew_fn, cp_delete_fn);
+        // Calls T move constructor (used by entity_migrate). A type with a destructor that releases resources needs a move
+        // constructor that leaves the source empty: without one the copy constructor is used and the source destructor
+        // releases the resources of the copy.
+        component_move_fn* cp_move_fn = nullptr;
+        if constexpr (std::is_move_constructible_v<T>) {
+            cp_move_fn = [](void* dst_cp, void* src_cp) { new (dst_cp) T(std::move(*(T*)src_cp)); };
+        }
+        component_register(cp_name, (i32)sizeof(T), cp_srlz_fn, cp_cleanup_fn, cp_placementnew_fn, cp_delete_fn, cp_move_fn);
     }
 
     // Returns the component cp for the entity e. (faster version) If entity has not the cp, undefined behaviour use entity_try_get instead 
@@ -308,6 +359,31 @@ struct registry {
     // Undefined behaviour if called multiple times on the same entity
     void entity_make_end(entity e);
 
+    // Reserves an entity handle of the type entity_name without constructing it. (Lock free, thread safe)
+    // The handle can be stored and referenced immediately, but it is not valid until entity_make_reserved is called on it.
+    // IMPORTANT:
+    // Undefined behaviour if called while the main thread is creating or destroying entities.
+    entity entity_reserve(const char* entity_name);
+
+    // Same as entity_make_begin but for an entity handle returned by entity_reserve (finish it with entity_make_end)
+    // IMPORTANT:
+    // Must be called from the main thread.
+    // Undefined behaviour if called multiple times on the same entity
+    void entity_make_reserved_begin(entity e);
+
+    // Instantiates an entity reserved with entity_reserve and calls the initialization function on it if it exists
+    // This will call internally entity_make_reserved_begin and then entity_make_end
+    // IMPORTANT:
+    // Must be called from the main thread.
+    void entity_make_reserved(entity e);
+
+    // Releases an entity handle returned by entity_reserve that will not be made, its id is recycled.
+    // The reserved handles that are never made or released keep their ids forever.
+    // IMPORTANT:
+    // Must be called from the main thread.
+    // Undefined behaviour if called while other threads are reserving entities.
+    void entity_release_reserved(entity e);
+
     // Returns true only if the entity is valid. Valid means that registry has created it and it's not null. 
     bool entity_valid(entity e);
 
@@ -338,9 +414,37 @@ struct registry {
     // IMPORTANT: Undefined Behaviour if you call this function while iterating views.
     void entity_destroy_all();
 
+    // Moves the entity e to the dst registry and returns the new entity handle in dst (e is released in this registry)
+    // The entity type and its components must be registered in both registries with the same names.
+    // The components are move constructed into dst, no init/deinit, cleanup or serialize functions are called.
+    // IMPORTANT: Entity handles stored inside the components (or elsewhere) are not remapped.
+    // It can be called from a system of any of the two registries (or outside systems), as long as:
+    //  - No other thread is running systems of any of the two registries (verified). With the app worlds this means
+    //    calling it from the app registry systems, the worlds are never simulated while they run.
+    //  - The calling thread is not iterating views of any of the two registries (Undefined Behaviour, not verified).
+    entity entity_migrate(entity e, registry* dst);
+
     //--------------------------------------------------------------------------------------------------
     // Views 
-    view view_create(const ds::darray<const char*>& cp_names);
+    view view_create(const ds::darray<const char*>& cp_names, std::source_location call_site = std::source_location::current());
+
+    // Views profiling statistics, accumulated per view call site (and system running it) 
+    // Only recorded when DS_ECS_VIEW_PROFILING is enabled (debug builds by default), else they are always empty.
+    // A high entities_visited/entities_accepted ratio means that the view is wasting time rejecting entities.
+    struct view_stats {
+        std::string call_site; // "file:line" where view_create was called
+        std::string cp_names; // components of the view
+        std::string sys_name; // system that was running when the view was created (empty if none)
+        i64 views_created = 0;
+        i64 entities_visited = 0; // entities iterated from the smallest storage
+        i64 entities_accepted = 0; // entities found in all the view storages
+        i64 storages_probed = 0; // storage contains checks performed
+        double miliseconds = 0; // time from view_create until the view becomes invalid (views abandoned before are not timed)
+    };
+
+    // Returns the accumulated views statistics since the registry creation or the last view_stats_reset
+    ds::darray<view_stats> view_stats_get();
+    void view_stats_reset();
 
     //--------------------------------------------------------------------------------------------------
     // Systems
@@ -350,13 +454,60 @@ struct registry {
         struct sys_run_stats {
             std::string sys_name;
             double miliseconds;
+            darray<view_stats> views; // views used by this system run (see DS_ECS_VIEW_PROFILING)
+            bool executed = true; // false if the system policy skipped this run
         };
         darray<sys_run_stats> sys_stats;
     };
+
+    // Scheduling policy of a system inside its queue. By default systems run on every execution of the queue.
+    //  every_n_ticks: runs once every n executions of the queue (the first execution always runs)
+    //  target_hz: runs at most hz times per second (measured with the platform performance counter)
+    //  time_sliced: runs on every execution with a miliseconds budget, see system_slice_current
+    struct system_policy {
+        enum class mode { always, every_n_ticks, target_hz, time_sliced };
+        mode run_mode = mode::always;
+        i32 ticks = 1;
+        double hz = 0;
+        double budget_ms = 0;
+
+        static system_policy always() { return {}; }
+        static system_policy every_n_ticks(i32 n) { return { .run_mode = mode::every_n_ticks, .ticks = n }; }
+        static system_policy target_hz(double hz) { return { .run_mode = mode::target_hz, .hz = hz }; }
+        static system_policy time_sliced(double budget_ms) { return { .run_mode = mode::time_sliced, .budget_ms = budget_ms }; }
+    };
+
+    // Time slice of a time_sliced system. The cursor is kept between executions so the system can resume its work. Example:
+    //  void ai_system(registry* r) {
+    //      system_slice* slice = r->system_slice_current();
+    //      view v = r->view_create({ "ai" });
+    //      v.seek(slice->cursor);
+    //      while (v.valid() && !slice->out_of_budget()) { ...; v.next(); }
+    //      slice->cursor = v.valid() ? v.cursor() : 0; // start again from the beginning when finished
+    //  }
+    struct system_slice {
+        i32 cursor = 0;
+        double deadline_ms = 0; // performance counter miliseconds where the budget runs out
+        // Returns true when the system has consumed its budget for this execution
+        bool out_of_budget();
+    };
+
+    // Precompiled queue identifier, resolve it once with system_queue_get to avoid the queue name lookups
+    struct system_queue_handle {
+        i32 idx = -1;
+    };
+
     #define DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue_name, fun) r->system_queue_add(queue_name, #fun , fun )
+    #define DS_REGISTRY_QUEUE_ADD_SYSTEM_POLICY(r, queue_name, fun, policy) r->system_queue_add(queue_name, #fun , fun, policy )
     typedef void (system_update_fn)(registry* r);
     void system_queue_add(const char* queue_name, const char* sys_name, system_update_fn* sys_update_fn);
+    void system_queue_add(const char* queue_name, const char* sys_name, system_update_fn* sys_update_fn, const system_policy& policy);
+    system_queue_handle system_queue_get(const char* queue_name); // Returns the queue handle for the queue name (creates an empty queue if it doesn't exist)
     sys_queue_run_stats system_queue_run(const char* queue_name);// This runs all the registered systems in the queue name and returns system statistics.
+    sys_queue_run_stats system_queue_run(system_queue_handle queue);// Same as above without the queue name lookup.
+
+    // Returns the time slice of the running time_sliced system or nullptr if the running system is not time sliced
+    system_slice* system_slice_current();
 
     
 
@@ -18,10 +18,45 @@ namespace ds {
 	// Clears all the primitives and cameras at the end.
 	void render_present();
 
+	// Statistics of the last presented frame, collected in render_present.
+	// Used to catch regressions in the batching efficiency (draw calls, state changes and uploads per frame).
+	struct render_frame_stats {
+		i32 primitives_submitted = 0; // draw commands submitted (including the dropped ones)
+		i32 primitives_dropped = 0; // not rendered because the per frame submission limit was exceeded
+		i32 draw_batches = 0; // draw commands after sorting and merging
+		i32 cameras = 0;
+		i32 draw_calls = 0; // for all the cameras, including the viewport clears
+		i32 pipeline_changes = 0;
+		i32 binding_changes = 0;
+		i64 vertices_uploaded = 0; // vertices and instances of all the streams
+		i64 bytes_uploaded = 0;
+		i64 stream_high_water_mark = 0; // max bytes uploaded to a single stream in a frame since render_init
+		i32 stream_reallocations = 0; // streams grown since render_init
+		double build_miliseconds = 0; // CPU time sorting and merging the draw commands and preparing the cameras
+		double upload_miliseconds = 0; // CPU time uploading the streams
+		double draw_miliseconds = 0; // CPU time issuing the draw calls of all the cameras
+		double gpu_miliseconds = -1; // GPU time of a recent frame with dynamic resolution (timer queries, -1 if not measured)
+		float scene_scale = 1.0f; // dynamic resolution scale of the frame (see app_config::dynamic_resolution)
+	};
+	render_frame_stats render_get_frame_stats();
+
+	// With app_config::render_thread the GL context belongs to the render thread while it draws a frame.
+	// The sokol resource calls from the game thread (creating or destroying images, buffers...) must be done between
+	// render_gpu_acquire and render_gpu_release, that wait for the current frame and make the GL context current.
+	// Without render thread they do nothing.
+	void render_gpu_acquire();
+	void render_gpu_release();
+
+	// Destroys a texture image (or releases its atlas space if atlas_slot is not null) once the frames that can draw it
+	// have been drawn: with app_config::render_thread the frames presented before are still in flight.
+	// Used by the cp::texture destructor, it can be called from any thread.
+	void render_texture_release(sg_image image, const struct atlas_region* atlas_slot);
+
 	// This sets a custom camera to render all the primitives
 	//	The viewport is the rectangle into which the contents of the
 	//	camera will be displayed, expressed as a factor (between 0 and 1)
 	//	of the size of the screen window to which the camera is applied.
+	//	With a virtual resolution (app_config::virtual_width) the viewport is relative to the virtual resolution image.
 	//	By default, a view has a viewport which covers the entire screen:
 	//	vec4(0.0, 0.0, 1.0, 1.0)
 	//	
@@ -30,29 +65,124 @@ namespace ds {
 	//	|______
 	//	(0,0)
 	//
-	// TODO: we only support one camera per frame now
-	void render_add_camera(const mat3& cam_ltw, vec4 cam_vp, float aspect, float ortho_width);
+	// Multiple cameras can be added each frame (split screen, minimap, ui overlay...). All of them render the same
+	// primitives, the ones with lower order are rendered first.
+	// The camera viewport is cleared with the clear_color before rendering, alpha 0 means don't clear.
+	// Returns the world space bounds of the camera (used to cull the primitives outside all the cameras).
+	rect render_add_camera(const mat3& cam_ltw, vec4 cam_vp, float aspect, float ortho_width, vec4 clear_color = { 0,0,0,0 }, i32 order = 0);
+
+	// Returns the world space bounds of the cameras added in this frame
+	std::vector<rect> render_get_cameras_bounds();
+
+	// SORTING LAYERS
+	// The primitives are drawn by sorting layer (lower order first) and inside each layer with the layer sort mode.
+	// The "default" layer (order 0, sorted by depth) always exists. Register the layers at init (max 16 layers),
+	// then select the layer where the draw primitives of the thread are submitted with render_set_sorting_layer:
+	//	const render_sorting_layer characters = render_sorting_layer_register("characters", render_sort_mode::y, 10);
+	//	...
+	//	const render_sorting_layer previous = render_set_sorting_layer(characters);
+	//	render_sprite(...);
+	//	render_set_sorting_layer(previous);
+	constexpr const char* RENDER_DEFAULT_SORTING_LAYER = "default";
+
+	enum class render_sort_mode {
+		none, // no order inside the layer, the primitives are grouped by pipeline and texture (the best batching)
+		depth, // by the depth argument, the higher depths are drawn on top
+		y, // by the position y, the lower positions are drawn on top (top-down games), the depth argument is ignored
+		custom // by the value returned by the layer sort_key function, the higher values are drawn on top
+	};
+
+	struct render_sorting_layer {
+		u32 id = 0; // the default layer is 0
+	};
+
+	// The sort_key function is only used by the custom layers. It can be called from any thread submitting primitives.
+	// The position is the primitive origin (the model translation, the shape center or the first point of a line).
+	// The y and custom sort values are quantized to 16 bits in the range of the values of the frame.
+	render_sorting_layer render_sorting_layer_register(const char* name, render_sort_mode mode, i32 order, float (*sort_key)(vec2 position, i32 depth) = nullptr);
+
+	// Returns the layer registered with the name (the default layer if not found)
+	render_sorting_layer render_sorting_layer_get(const char* name);
+
+	// Sets the sorting layer of the primitives submitted by this thread, returns the previous one
+	render_sorting_layer render_set_sorting_layer(render_sorting_layer layer);
 
 	// DRAW PRIMITIVES
+	// The draw primitives functions can be called from any thread: each thread writes to its own submission context
+	// and the contexts are merged in render_present (that can't run while other threads are submitting).
 
-	// Submit a draw line primitive
-	void render_line(const std::vector<vec2>& points, vec4 color = { 1,1,1,1 }, i32 depth = 0);
+	// Submit a draw line primitive (polyline with miter joins and square caps, closed if the first and last points are equal)
+	// The width is in world units, negative values are in pixels (the default is a 1 pixel line).
+	void render_line(const std::vector<vec2>& points, vec4 color = { 1,1,1,1 }, i32 depth = 0, float width = -1);
 
-	// Submit a draw circle primitive
+	// Circles, rings, capsules and rounded rects are signed distance field shapes: each one is a single antialiased quad.
+	// The thickness of the outlines is in world units, negative values are in pixels. A thickness of 0 is a filled shape.
+
+	// Submit a draw circle primitive (1 pixel outline)
 	void render_circle(vec2 center, float radius = 25.f, vec4 color = { 1,1,1,1 }, i32 depth = 0);
 
 	// Submit a draw filled circle primitive
 	void render_fill_circle(vec2 center, float radius = 25.f, vec4 color = { 1,1,1,1 }, i32 depth = 0);
 
+	// Submit a draw ring primitive (circle outline with thickness, inside the radius)
+	void render_ring(vec2 center, float radius, float thickness, vec4 color = { 1,1,1,1 }, i32 depth = 0);
+
+	// Submit a draw capsule primitive (segment from a to b with radius)
+	void render_capsule(vec2 a, vec2 b, float radius, vec4 color = { 1,1,1,1 }, i32 depth = 0, float thickness = 0);
+
+	// Submit a draw rounded rectangle primitive
+	void render_rounded_rect(const mat3& model, vec2 size, float corner_radius, vec4 color = { 1,1,1,1 }, i32 depth = 0, float thickness = 0);
+
 	// Submit a draw rectangle primitive
-	void render_rect(const mat3& model, vec2 size, vec4 color = { 1,1,1,1 }, i32 depth = 0);
+	void render_rect(const mat3& model, vec2 size, vec4 color = { 1,1,1,1 }, i32 depth = 0, float width = -1);
 
 	// Submit a draw filled rectangle primitive
 	void render_fill_rect(const mat3& model, vec2 size, vec4 color = { 1,1,1,1 }, i32 depth = 0);
 
 	// Submit a draw texture rectangle primitive
+	// The source_rect is in normalized uv coordinates, values are clamped to [0, 1] (vertex uvs are packed as unorm16)
 	void render_texture(const mat3& model, sg_image texture = { 0 }, vec2 size = { 1,1 }, rect source_rect = rect::from_size({ 0,0 }, { 1, 1 }), vec4 color = { 1,1,1,1 }, i32 depth = 0);
 
+	// Submit a sprite primitive: a textured unit quad (size 1x1 centered at the origin) transformed by the model matrix.
+	// Sprites are drawn with an instanced pipeline (one 40 bytes instance per sprite), use it instead of render_texture
+	// when rendering lots of textured quads. The uv_rect is normalized.
+	// With app_config::depth_opaque_pass the opaque sprites (texture pixels with alpha 0 or 1 and color alpha 1) are
+	// drawn front to back with the depth test before the rest of the primitives, their transparent pixels are discarded.
+	void render_sprite(const mat3& model, sg_image texture, rect uv_rect = rect::from_size({ 0,0 }, { 1, 1 }), vec4 color = { 1,1,1,1 }, i32 depth = 0, bool opaque = false);
+
 	//void render_texture(registry* r, const mat3& model, resource texture, vec2 size = { 1,1 }, rect source_rect = rect::from_size({ 0,0 }, { 1, 1 }), vec4 color = { 1,1,1,1 }, i32 depth = 0);
 	/*void draw_texture(const mat3& model, resource<image> img, vec2 size = { 1,1 }, rect source_rect = rect::from_size({ 0,0 }, { 1, 1 }), vec4 color = { 1,1,1,1 }, i32 depth = 0);*/
+
+	// RETAINED LAYERS
+	// Static geometry (backgrounds, tile layers...) recorded once with the draw primitives functions and kept in
+	// immutable GPU buffers. Submitting a layer only costs a draw command, the layer is drawn with its model matrix.
+	// The layers are created dirty, re-record them when they are marked dirty:
+	//	if (render_layer_is_dirty(layer)) {
+	//		render_layer_begin(layer);
+	//		render_sprite(...); render_fill_rect(...); ...
+	//		render_layer_end(layer);
+	//	}
+	//	render_layer_submit(layer, model, depth);
+	struct render_layer {
+		u32 id = 0;
+		u32 version = 0; // the ids are reused, the version tells apart the layers created in the same slot
+	};
+
+	// At most app_config::max_render_layers layers can be alive at the same time.
+	render_layer render_layer_create();
+	// Returns false instead of failing when the app_config::max_render_layers layers are alive
+	bool render_layer_try_create(render_layer* out_layer);
+	void render_layer_destroy(render_layer layer);
+
+	// The draw primitives submitted by this thread between begin and end are recorded in the layer instead of the frame.
+	// render_layer_end sorts them and uploads them to the GPU (the previous layer contents are replaced).
+	void render_layer_begin(render_layer layer);
+	void render_layer_end(render_layer layer);
+
+	// Marks the layer to be recorded again (render_layer_end clears the flag)
+	void render_layer_set_dirty(render_layer layer);
+	bool render_layer_is_dirty(render_layer layer);
+
+	// Draws the layer in this frame transformed by the model matrix, all its primitives are drawn at this depth
+	void render_layer_submit(render_layer layer, const mat3& model, i32 depth = 0);
 }
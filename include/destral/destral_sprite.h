@@ -3,6 +3,7 @@
 #include <destral/destral_image.h>
 #include <destral/destral_texture.h>
 #include <destral/destral_containers.h>
+#include <destral/destral_renderer.h>
 
 
 namespace ds {
@@ -16,7 +17,8 @@ namespace ds {
 			constexpr const char* name = "ds_sprite_renderer_en";
 			void register_entity(registry* r);
 
-			// This system renders all the sprite sprite_renderer entities
+			// This system renders all the sprite sprite_renderer entities, the ones outside the bounds of all the cameras are culled.
+			// It must run after the cameras are added (en::camera::render_cameras_system).
 			void render_sprites(registry* r);
 
 			void update_sprite_animation_frame(registry* r);
@@ -169,6 +171,12 @@ namespace ds {
 
 			}
 
+			// Depth of the sprite inside its sorting layer (only used by the layers sorted by depth)
+			i32 depth = 0;
+
+			// Sorting layer where the sprite is drawn (see render_sorting_layer_register)
+			render_sorting_layer sorting_layer;
+
 		private:
 			entity sprite_to_render = entity_null;
 			i32 cur_animation_hash_key;
@@ -2,6 +2,7 @@
 #include <destral/thirdparty/sokol_gfx.h>
 #include <destral/destral_ecs.h>
 #include <destral/destral_math.h>	
+#include <destral/destral_atlas.h>
 
 namespace ds {
 
@@ -9,13 +10,40 @@ namespace ds {
 	namespace cp {
 		struct texture {
 			static constexpr const char* name = "ds_texture_cp";
+			// GPU image to bind, an atlas page if the texture is atlased
 			sg_image gpu_texid = { .id = 0 };
+
+			// Size of the texture in pixels
+			ivec2 size_px = { 0,0 };
+
+			// True if the texture is packed in an atlas page (see destral_atlas.h), the page is not owned by the texture
+			bool is_atlased = false;
+
+			// True if all the pixels are fully opaque or fully transparent (can be drawn as an opaque sprite, see render_sprite)
+			bool is_opaque = false;
+
+			// Normalized rect of the texture inside gpu_texid ({0,0}-{1,1} if not atlased)
+			rect atlas_uv_rect = { {0,0}, {1,1} };
+
+			// Space of the texture in the atlas page, released when the texture is destroyed
+			atlas_region atlas_slot;
+
+			texture() = default;
+			// The move constructor (used by entity_migrate) takes the GPU image and the atlas space, the source is left empty
+			texture(texture&& other) noexcept;
+			texture(const texture&) = delete;
 			~texture();
 			// Registers the texture component to the registry
 			static void register_component(registry* r);
 
 			// Returns the size of the texture in pixels
 			ivec2 get_size();
+
+			// Remaps a normalized uv rect of the texture to the gpu_texid coordinates
+			rect remap_uv(rect uv) const {
+				const vec2 atlas_size = atlas_uv_rect.max - atlas_uv_rect.min;
+				return { atlas_uv_rect.min + uv.min * atlas_size, atlas_uv_rect.min + uv.max * atlas_size };
+			}
 		};
 	}
 
@@ -0,0 +1,76 @@
+#pragma once
+#include <destral/destral_ecs.h>
+#include <destral/destral_math.h>
+#include <destral/destral_containers.h>
+#include <destral/destral_renderer.h>
+
+namespace ds {
+	namespace cp {
+		// Tile map split in chunks of CHUNK_SIZE x CHUNK_SIZE tiles.
+		// The tiles of each chunk are cached in a retained render layer that is only rebuilt when its tiles change,
+		// and only the chunks inside the cameras bounds are submitted.
+		// At most MAX_CACHED_CHUNKS layers are kept per tilemap: when there are more, the layers of the chunks that have
+		// not been visible for longer are destroyed (they are rebuilt when they become visible again). The visible chunks
+		// that don't fit in the cache (or in app_config::max_render_layers) are submitted tile by tile every frame.
+		// The tile (0,0) is at the entity origin, x grows to the right and y grows up.
+		struct tilemap {
+			static constexpr const char* name = "ds_tilemap_cp";
+			static constexpr i32 CHUNK_SIZE = 32;
+			static constexpr u16 TILE_EMPTY = 0;
+			static constexpr i32 MAX_CACHED_CHUNKS = 32; // well under app_config::max_render_layers
+			static void register_component(registry* r);
+			static void cleanup(registry* r, entity e, void* cp);
+
+			// Tileset texture entity (en::texture). The tiles are numbered from 1, from left to right and from top to bottom.
+			entity tileset = entity_null;
+
+			// Size of a tile in the tileset in pixels
+			ivec2 tile_size_px = { 16,16 };
+
+			// Size of a tile in the entity local space
+			vec2 tile_size = { 1,1 };
+
+			// Depth of all the tiles (see render_layer_submit)
+			i32 depth = 0;
+
+			// Sorting layer where the tiles are drawn (see render_sorting_layer_register)
+			render_sorting_layer sorting_layer;
+
+			// Resizes the map to size tiles, all the tiles are cleared to TILE_EMPTY
+			void resize(ivec2 size_in_tiles);
+			ivec2 size() const { return _size; }
+
+			// Sets a tile, the chunk of the tile will be rebuilt the next time that it is rendered
+			void set_tile(ivec2 pos, u16 tile);
+			u16 get_tile(ivec2 pos) const;
+
+			// Marks all the chunks to be rebuilt (use it after changing the tileset or the tile sizes)
+			void set_dirty();
+
+			struct chunk {
+				u16 tiles[CHUNK_SIZE * CHUNK_SIZE] = { TILE_EMPTY };
+				render_layer layer; // created the first time the chunk is rendered
+				bool dirty = true;
+				u64 last_visible_frame = 0;
+			};
+
+			ivec2 _size = { 0,0 };
+			ivec2 _chunks_count = { 0,0 };
+			darray<chunk> _chunks;
+			i32 _cached_chunks = 0; // chunks with a layer
+			u64 _frame = 0; // render_tilemaps calls that submitted the tilemap
+		};
+	}
+
+	namespace en {
+		// The tilemap entity contains the cp::tilemap and cp::hierarchy components
+		namespace tilemap {
+			constexpr const char* name = "ds_tilemap_en";
+			void register_entity(registry* r);
+
+			// This system rebuilds the dirty visible chunks and submits the visible chunks of all the tilemaps.
+			// It must run after the cameras are added (en::camera::render_cameras_system).
+			void render_tilemaps(registry* r);
+		}
+	}
+}
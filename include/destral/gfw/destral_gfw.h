@@ -220,8 +220,12 @@ namespace ds {
 			// 
 			glm::vec4 viewport = glm::vec4(0.f, 0.f, 1.f, 1.f);
 
-			/** @brief color used when the camera clears their viewport */
-			glm::vec4 clear_color = glm::vec4{ 0.5f, 0.5f, 0.5f, 1.0f };
+			/** @brief color used when the camera clears their viewport (alpha 0 means don't clear, the default: the cameras
+			 * are drawn over the frame clear color and over the cameras with lower order) */
+			glm::vec4 clear_color = glm::vec4{ 0.5f, 0.5f, 0.5f, 0.0f };
+
+			// cameras with lower order are rendered first (use a higher order for minimaps or ui overlays)
+			i32 order = 0;
 
 			// ortho width size in world units
 			float ortho_width = 1.0f;
@@ -229,6 +233,9 @@ namespace ds {
 			// aspect ratio of the camera, used to calculate the height, based on ortho_width
 			float aspect = 16.0f / 9.0f;
 
+			// world space bounds of the camera in the last rendered frame (updated by render_cameras_system)
+			rect world_bounds;
+
 
 		};
 	}
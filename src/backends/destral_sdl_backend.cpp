@@ -399,6 +399,13 @@ namespace ds::platform_backend {
 		DS_LOG(std::format("SDL v.{}.{}.{}", version.major, version.minor, version.patch));
 
 
+		// headless apps only use the SDL timers and events, there is no window or GL context
+		if (app_get_config().headless) {
+			dsverifym(SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS) == 0, "Failed to initialize SDL2");
+			sdl::init_keys();
+			return;
+		}
+
 		// initialize SDL
 		dsverifym(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_EVENTS | SDL_INIT_GAMECONTROLLER) == 0, "Failed to initialize SDL2");
 
@@ -415,7 +422,7 @@ namespace ds::platform_backend {
 		SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_FORWARD_COMPATIBLE_FLAG);
 
 		//SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-		//SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+		SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24); // the depth mode needs more than the default 16 bits (see app_config::depth_opaque_pass)
 		//SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
 		//SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
 		//SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
@@ -616,11 +623,16 @@ namespace ds::platform_backend {
 
 	// Called to present the window contents
 	void swap_buffers() {
+		if (sdl::g_sdl.window == nullptr) {
+			return; // headless
+		}
 		SDL_GL_SwapWindow(sdl::g_sdl.window);
 	}
 
 	// Sets the Window Fullscreen if enabled is not 0
 	void set_fullscreen(bool enabled) {
+		if (sdl::g_sdl.window == nullptr)
+			return; // headless
 		if (enabled)
 			SDL_SetWindowFullscreen(sdl::g_sdl.window, SDL_WINDOW_FULLSCREEN_DESKTOP);
 		else
@@ -653,6 +665,11 @@ namespace ds::platform_backend {
 	void get_drawable_size(i32* width, i32* height) {
 		dscheck(width);
 		dscheck(height);
+		// headless apps use the configured size
+		if (sdl::g_sdl.window == nullptr) {
+			*width = app_get_config().width; *height = app_get_config().height;
+			return;
+		}
 		// IMPORTANT This is only GL
 		int x, y;
 		SDL_GL_GetDrawableSize(sdl::g_sdl.window, &x, &y);
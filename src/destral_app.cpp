@@ -8,8 +8,12 @@
 #include <destral/destral_renderer.h>
 #include <destral/gfw/destral_gfw.h>
 #include <destral/destral_sprite.h>
+#include <destral/destral_tilemap.h>
 
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 // Idea from:
 // https://github.com/NoelFB/blah/blob/master/src/core/app.cpp
@@ -21,9 +25,45 @@ namespace ds {
 		std::chrono::duration<float> current_fixed_dt = std::chrono::seconds(0);
 	};
 
+	// system queues handles, resolved once after the ecs configuration
+	struct queue_handles {
+		registry::system_queue_handle engine_init;
+		registry::system_queue_handle engine_update;
+		registry::system_queue_handle engine_render;
+		registry::system_queue_handle engine_deinit;
+		registry::system_queue_handle game_init;
+		registry::system_queue_handle game_update;
+		registry::system_queue_handle game_fixed_update;
+		registry::system_queue_handle game_render;
+		registry::system_queue_handle game_deinit;
+	};
+
 	struct app {
 		bool is_exiting = false;
 		bool doing_fixed_update = false;
+		queue_handles queues;
+	};
+
+	// A world is an independent registry simulated in the worker threads
+	struct world {
+		registry* r = nullptr;
+		queue_handles queues;
+	};
+
+	// Persistent worker threads that run one queue of all the worlds in parallel.
+	// Each dispatch hands out the worlds with an atomic index, the main thread also runs worlds until all are finished.
+	struct world_workers {
+		ds::darray<std::thread*> threads;
+		std::mutex mutex;
+		std::condition_variable cv_work;
+		std::condition_variable cv_done;
+		u64 generation = 0; // incremented on each dispatch
+		i32 working = 0; // workers that didn't finish the current dispatch
+		bool exiting = false;
+
+		// current dispatch
+		registry::system_queue_handle queue_handles::* queue = nullptr;
+		std::atomic<i32> next_world = 0;
 	};
 
 	// global instances
@@ -31,20 +71,175 @@ namespace ds {
 	static app_config g_cfg;
 	static time g_time;
 	static registry* g_registry = nullptr;
+	static ds::darray<world> g_worlds;
+	static world_workers g_workers;
+
+	// Appends the renderer stats of the last presented frame to the log text
+	static void s_append_render_stats(std::string* s) {
+		const render_frame_stats rs = render_get_frame_stats();
+		*s += std::format("Renderer last frame:\n\t primitives: {}   dropped: {}   batches: {}   cameras: {}   draw calls: {}   pipeline changes: {}   binding changes: {}\n",
+			rs.primitives_submitted, rs.primitives_dropped, rs.draw_batches, rs.cameras, rs.draw_calls, rs.pipeline_changes, rs.binding_changes);
+		*s += std::format("\t uploaded vertices: {}   uploaded bytes: {}   stream high water mark: {}   stream reallocations: {}\n",
+			rs.vertices_uploaded, rs.bytes_uploaded, rs.stream_high_water_mark, rs.stream_reallocations);
+		*s += std::format("\t build milis: {}   upload milis: {}   draw milis: {}   gpu milis: {}   scene scale: {}\n", rs.build_miliseconds, rs.upload_miliseconds, rs.draw_miliseconds, rs.gpu_miliseconds, rs.scene_scale);
+	}
 
-	static void s_run_queue(registry* r, const char* queue_name, bool log_run = false) {
+	static void s_run_queue(registry* r, registry::system_queue_handle queue, bool log_run = false) {
 		if (!log_run) {
-			r->system_queue_run(queue_name);
+			r->system_queue_run(queue);
 		} else {
-			auto stats = r->system_queue_run(queue_name);
+			auto stats = r->system_queue_run(queue);
 			std::string s = std::format("\nSystems queue {}:\n", stats.queue_name);
 			for (i32 i = 0; i < stats.sys_stats.size(); i++) {
+				if (!stats.sys_stats[i].executed) {
+					s += std::format("\t sys: {}   skipped\n", stats.sys_stats[i].sys_name);
+					continue;
+				}
 				s += std::format("\t sys: {}   milis: {}\n", stats.sys_stats[i].sys_name, stats.sys_stats[i].miliseconds);
+				const auto& views = stats.sys_stats[i].views;
+				for (i32 j = 0; j < views.size(); j++) {
+					s += std::format("\t\t view: [{}] {}   created: {}   visited: {}   accepted: {}   probed: {}   milis: {}\n",
+						views[j].cp_names, views[j].call_site, views[j].views_created, views[j].entities_visited,
+						views[j].entities_accepted, views[j].storages_probed, views[j].miliseconds);
+				}
+			}
+			// the engine render queue presents the frame, the renderer stats only change after it
+			if (r == g_registry && queue.idx == g_app.queues.engine_render.idx) {
+				s_append_render_stats(&s);
 			}
 			DS_LOG(s);
 		}
 	}
 
+	static void s_resolve_queues(registry* r, queue_handles* q) {
+		q->engine_init = r->system_queue_get(queue::engine::init);
+		q->engine_update = r->system_queue_get(queue::engine::update);
+		q->engine_render = r->system_queue_get(queue::engine::render);
+		q->engine_deinit = r->system_queue_get(queue::engine::deinit);
+		q->game_init = r->system_queue_get(queue::game::init);
+		q->game_update = r->system_queue_get(queue::game::update);
+		q->game_fixed_update = r->system_queue_get(queue::game::fixed_update);
+		q->game_render = r->system_queue_get(queue::game::render);
+		q->game_deinit = r->system_queue_get(queue::game::deinit);
+	}
+
+	// Runs the current dispatch queue on the worlds not taken yet by other threads
+	static void s_workers_run_worlds() {
+		for (i32 i = g_workers.next_world.fetch_add(1); i < g_worlds.size(); i = g_workers.next_world.fetch_add(1)) {
+			world& w = g_worlds[i];
+			w.r->system_queue_run(w.queues.*g_workers.queue);
+		}
+	}
+
+	static void s_worker_loop() {
+		u64 generation = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(g_workers.mutex);
+				g_workers.cv_work.wait(lock, [&] { return g_workers.exiting || g_workers.generation != generation; });
+				if (g_workers.exiting) {
+					return;
+				}
+				generation = g_workers.generation;
+			}
+
+			s_workers_run_worlds();
+
+			std::lock_guard<std::mutex> lock(g_workers.mutex);
+			if (--g_workers.working == 0) {
+				g_workers.cv_done.notify_one();
+			}
+		}
+	}
+
+	static void s_workers_init() {
+		i32 count = g_cfg.world_worker_threads;
+		if (count <= 0) {
+			count = std::max((i32)std::thread::hardware_concurrency() - 1, 0);
+		}
+		for (i32 i = 0; i < count; i++) {
+			g_workers.threads.push_back(new std::thread(s_worker_loop));
+		}
+	}
+
+	static void s_workers_deinit() {
+		{
+			std::lock_guard<std::mutex> lock(g_workers.mutex);
+			g_workers.exiting = true;
+		}
+		g_workers.cv_work.notify_all();
+		for (i32 i = 0; i < g_workers.threads.size(); i++) {
+			g_workers.threads[i]->join();
+			delete g_workers.threads[i];
+		}
+		g_workers.threads.clear();
+	}
+
+	// Runs the queue of each world in parallel and waits until all of them are finished
+	static void s_run_worlds_queue(registry::system_queue_handle queue_handles::* queue) {
+		if (g_worlds.empty()) {
+			return;
+		}
+
+		if (g_worlds.size() == 1 || g_workers.threads.empty()) {
+			for (i32 i = 0; i < g_worlds.size(); i++) {
+				g_worlds[i].r->system_queue_run(g_worlds[i].queues.*queue);
+			}
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(g_workers.mutex);
+			g_workers.queue = queue;
+			g_workers.next_world = 0;
+			g_workers.working = g_workers.threads.size();
+			g_workers.generation++;
+		}
+		g_workers.cv_work.notify_all();
+
+		// the main thread also simulates worlds
+		s_workers_run_worlds();
+
+		std::unique_lock<std::mutex> lock(g_workers.mutex);
+		g_workers.cv_done.wait(lock, [] { return g_workers.working == 0; });
+	}
+
+	registry* app_world_create() {
+		dsverifym(g_cfg.on_world_config, "app_config::on_world_config is not set, worlds can't be configured.");
+		if (g_workers.threads.empty()) {
+			s_workers_init();
+		}
+
+		world w;
+		w.r = new registry();
+		g_cfg.on_world_config(w.r);
+		s_resolve_queues(w.r, &w.queues);
+		g_worlds.push_back(w);
+
+		s_run_queue(w.r, w.queues.game_init);
+		return w.r;
+	}
+
+	void app_world_destroy(registry* r) {
+		for (i32 i = 0; i < g_worlds.size(); i++) {
+			if (g_worlds[i].r == r) {
+				s_run_queue(r, g_worlds[i].queues.game_deinit);
+				g_worlds.remove_at(i);
+				delete r;
+				return;
+			}
+		}
+		DS_FATAL("Trying to destroy a world not created with app_world_create.");
+	}
+
+	ds::darray<registry*> app_worlds() {
+		ds::darray<registry*> worlds;
+		for (i32 i = 0; i < g_worlds.size(); i++) {
+			worlds.push_back(g_worlds[i].r);
+		}
+		return worlds;
+	}
+
 	app_config app_get_config() {
 		return g_cfg;
 	}
@@ -60,11 +255,13 @@ namespace ds {
 		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::init, cp::hierarchy::register_component);
 		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::init, cp::sprite::register_component);
 		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::init, cp::sprite_renderer::register_component);
+		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::init, cp::tilemap::register_component);
 		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::init, en::texture_loader::register_entity);
 		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::init, en::texture::register_entity);
 		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::init, en::camera::register_entity);
 		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::init, en::sprite::register_entity);
 		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::init, en::sprite_renderer::register_entity);
+		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::init, en::tilemap::register_entity);
 		r->system_queue_add(queue::engine::init, "render_init", [](registry* r) { render_init(); });
 
 		
@@ -75,11 +272,16 @@ namespace ds {
 		r->system_queue_add(queue::engine::update, "platform_poll_events", [](registry* r) { platform_backend::poll_events(); });
 
 		
+		// the cameras are added first, their bounds are used to cull the tilemaps chunks and the sprites
+		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::render, en::camera::render_cameras_system);
 		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::render, en::sprite_renderer::update_sprite_animation_frame);
+		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::render, en::tilemap::render_tilemaps);
 		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::render, en::sprite_renderer::render_sprites);
-		DS_REGISTRY_QUEUE_ADD_SYSTEM(r, queue::engine::render, en::camera::render_cameras_system);
 		r->system_queue_add(queue::engine::render, "render_present", [](registry* r) { render_present(); });
-		r->system_queue_add(queue::engine::render, "render_swap_buffers", [](registry* r) { platform_backend::swap_buffers(); });
+		r->system_queue_add(queue::engine::render, "render_swap_buffers", [](registry* r) {
+			// the render thread swaps the buffers after drawing each frame
+			if (!app_get_config().render_thread) { platform_backend::swap_buffers(); }
+		});
 
 
 		// Engine deinit
@@ -97,9 +299,12 @@ namespace ds {
 		init_engine_ecs(g_registry);
 		if (g_cfg.on_ecs_config) { g_cfg.on_ecs_config(g_registry); }
 
+		// resolve the queues once, the loop will not perform queue name lookups
+		s_resolve_queues(g_registry, &g_app.queues);
+
 		// run init systems
-		s_run_queue(g_registry, queue::engine::init);
-		s_run_queue(g_registry, queue::game::init);
+		s_run_queue(g_registry, g_app.queues.engine_init);
+		s_run_queue(g_registry, g_app.queues.game_init);
 
 		typedef std::chrono::high_resolution_clock hrclock;
 		hrclock::time_point last = hrclock::now();
@@ -144,8 +349,9 @@ namespace ds {
 			// 1) Full tick perform
 			{
 				// 2) Tick for the full frame dt (independent timestep)
-				s_run_queue(g_registry, queue::engine::update);
-				s_run_queue(g_registry, queue::game::update);
+				s_run_queue(g_registry, g_app.queues.engine_update);
+				s_run_queue(g_registry, g_app.queues.game_update);
+				s_run_worlds_queue(&queue_handles::game_update);
 			}
 
 
@@ -153,7 +359,8 @@ namespace ds {
 			{
 				g_app.doing_fixed_update = true;
 				while (g_time.dt_fixed_acc >= g_time.current_fixed_dt) {
-					s_run_queue(g_registry, queue::game::fixed_update);
+					s_run_queue(g_registry, g_app.queues.game_fixed_update);
+					s_run_worlds_queue(&queue_handles::game_fixed_update);
 					g_time.dt_fixed_acc -= g_time.current_fixed_dt;
 				}
 				g_app.doing_fixed_update = false;
@@ -161,17 +368,21 @@ namespace ds {
 
 			// 3) render
 			{
-				s_run_queue(g_registry, queue::engine::render);
-				s_run_queue(g_registry, queue::game::render);
+				s_run_queue(g_registry, g_app.queues.engine_render);
+				s_run_queue(g_registry, g_app.queues.game_render);
 			}
 		}
 
 
 		// Cleanup process
 		{
+			while (!g_worlds.empty()) {
+				app_world_destroy(g_worlds.back().r);
+			}
+			s_workers_deinit();
 
-			s_run_queue(g_registry,queue::game::deinit);
-			s_run_queue(g_registry,queue::engine::deinit);
+			s_run_queue(g_registry, g_app.queues.game_deinit);
+			s_run_queue(g_registry, g_app.queues.engine_deinit);
 			
 			delete g_registry;
 		}
@@ -0,0 +1,217 @@
+#include <destral/destral_atlas.h>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+namespace ds {
+
+	// Row of packed textures, the textures are placed from left to right
+	struct atlas_shelf {
+		i32 y = 0;
+		i32 height = 0;
+		i32 x = 0; // next free column
+		std::vector<ivec2> free_slots; // (x, width) of the removed textures before the next free column
+	};
+
+	struct atlas_page {
+		sg_image image = { .id = 0 };
+		std::vector<u8> pixels; // RGBA8, ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE
+		std::vector<atlas_shelf> shelves;
+		i32 next_shelf_y = 0;
+		i32 regions = 0; // packed textures not removed
+		bool dirty = false; // pixels modified since the last upload
+	};
+
+	struct atlas_state {
+		std::vector<atlas_page> pages;
+	};
+
+	static atlas_state g_atlas;
+
+	static atlas_page* s_page_create() {
+		atlas_page& page = g_atlas.pages.emplace_back();
+		page.pixels.resize((size_t)ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE * 4, 0);
+
+		sg_image_desc image_desc = { 0 };
+		image_desc.width = ATLAS_PAGE_SIZE;
+		image_desc.height = ATLAS_PAGE_SIZE;
+		image_desc.usage = SG_USAGE_DYNAMIC;
+		image_desc.pixel_format = SG_PIXELFORMAT_RGBA8;
+		image_desc.min_filter = SG_FILTER_NEAREST;
+		image_desc.mag_filter = SG_FILTER_NEAREST;
+		image_desc.wrap_u = SG_WRAP_CLAMP_TO_EDGE;
+		image_desc.wrap_v = SG_WRAP_CLAMP_TO_EDGE;
+		image_desc.label = "atlas-page";
+		if (sg_isvalid()) { // no GPU images in headless apps
+			page.image = sg_make_image(image_desc);
+		}
+		DS_LOG(std::format("Atlas page {} created", g_atlas.pages.size() - 1));
+		return &page;
+	}
+
+	// Reuses the smallest free slot of the page shelves where a w x h rectangle fits
+	static bool s_page_allocate_free_slot(atlas_page* page, i32 w, i32 h, ivec2* out_pos, i32* out_shelf) {
+		atlas_shelf* best_shelf = nullptr;
+		size_t best_slot = 0;
+		for (atlas_shelf& shelf : page->shelves) {
+			if (shelf.height < h || shelf.height > h * 2) {
+				continue;
+			}
+			for (size_t i = 0; i < shelf.free_slots.size(); i++) {
+				if (shelf.free_slots[i].y >= w && (!best_shelf || shelf.free_slots[i].y < best_shelf->free_slots[best_slot].y)) {
+					best_shelf = &shelf;
+					best_slot = i;
+				}
+			}
+		}
+		if (!best_shelf) {
+			return false;
+		}
+		ivec2& slot = best_shelf->free_slots[best_slot];
+		*out_pos = { slot.x, best_shelf->y };
+		*out_shelf = (i32)(best_shelf - page->shelves.data());
+		slot.x += w;
+		slot.y -= w;
+		if (slot.y == 0) {
+			best_shelf->free_slots.erase(best_shelf->free_slots.begin() + best_slot);
+		}
+		return true;
+	}
+
+	// Finds space for a w x h rectangle in the page shelves (the one with less wasted height), opens a new shelf if needed
+	static bool s_page_allocate(atlas_page* page, i32 w, i32 h, ivec2* out_pos, i32* out_shelf) {
+		if (s_page_allocate_free_slot(page, w, h, out_pos, out_shelf)) {
+			return true;
+		}
+
+		atlas_shelf* best = nullptr;
+		for (atlas_shelf& shelf : page->shelves) {
+			if (shelf.height >= h && shelf.x + w <= ATLAS_PAGE_SIZE) {
+				if (!best || shelf.height < best->height) {
+					best = &shelf;
+				}
+			}
+		}
+
+		// wasting more than half of the shelf height, better to open a new shelf if there is space
+		if ((!best || best->height > h * 2) && page->next_shelf_y + h <= ATLAS_PAGE_SIZE) {
+			page->shelves.push_back({ .y = page->next_shelf_y, .height = h, .x = 0 });
+			page->next_shelf_y += h;
+			best = &page->shelves.back();
+		}
+
+		if (!best) {
+			return false;
+		}
+		*out_pos = { best->x, best->y };
+		*out_shelf = (i32)(best - page->shelves.data());
+		best->x += w;
+		return true;
+	}
+
+	// Copies the texture pixels to the page at pos (the padded rect origin) extruding the border pixels into the padding
+	static void s_page_blit(atlas_page* page, const u8* pixels, ivec2 size, ivec2 pos) {
+		const i32 padded_w = size.x + ATLAS_PADDING * 2;
+		const i32 padded_h = size.y + ATLAS_PADDING * 2;
+		for (i32 y = 0; y < padded_h; y++) {
+			const i32 src_y = std::clamp(y - ATLAS_PADDING, 0, size.y - 1);
+			u8* dst_row = page->pixels.data() + ((size_t)(pos.y + y) * ATLAS_PAGE_SIZE + pos.x) * 4;
+			const u8* src_row = pixels + (size_t)src_y * size.x * 4;
+			for (i32 x = 0; x < padded_w; x++) {
+				const i32 src_x = std::clamp(x - ATLAS_PADDING, 0, size.x - 1);
+				std::memcpy(dst_row + x * 4, src_row + src_x * 4, 4);
+			}
+		}
+		page->dirty = true;
+	}
+
+	bool atlas_add(const u8* pixels, ivec2 size, atlas_region* out_region) {
+		dscheck(pixels && out_region);
+		if (size.x <= 0 || size.y <= 0 || size.x > ATLAS_MAX_TEXTURE_SIZE || size.y > ATLAS_MAX_TEXTURE_SIZE) {
+			return false;
+		}
+
+		const i32 padded_w = size.x + ATLAS_PADDING * 2;
+		const i32 padded_h = size.y + ATLAS_PADDING * 2;
+		ivec2 pos;
+		i32 shelf_idx = -1;
+		atlas_page* page = nullptr;
+		for (atlas_page& p : g_atlas.pages) {
+			if (s_page_allocate(&p, padded_w, padded_h, &pos, &shelf_idx)) {
+				page = &p;
+				break;
+			}
+		}
+		if (!page) {
+			page = s_page_create();
+			const bool allocated = s_page_allocate(page, padded_w, padded_h, &pos, &shelf_idx);
+			dsverifym(allocated, "The texture doesn't fit in an empty atlas page.");
+		}
+
+		s_page_blit(page, pixels, size, pos);
+		page->regions++;
+		const vec2 min_px = vec2(pos + ATLAS_PADDING);
+		out_region->page = page->image;
+		out_region->uv_rect = rect::from_size(min_px / (float)ATLAS_PAGE_SIZE, vec2(size) / (float)ATLAS_PAGE_SIZE);
+		out_region->page_idx = (i32)(page - g_atlas.pages.data());
+		out_region->shelf_idx = shelf_idx;
+		out_region->x = pos.x;
+		out_region->width = padded_w;
+		return true;
+	}
+
+	void atlas_remove(const atlas_region& region) {
+		if (region.page_idx < 0 || region.page_idx >= (i32)g_atlas.pages.size()) {
+			return; // the atlas was destroyed before the texture
+		}
+		atlas_page& page = g_atlas.pages[region.page_idx];
+		dsverify(region.shelf_idx >= 0 && region.shelf_idx < (i32)page.shelves.size() && page.regions > 0);
+		if (--page.regions == 0) {
+			// empty page, all its space is available again
+			page.shelves.clear();
+			page.next_shelf_y = 0;
+			return;
+		}
+
+		atlas_shelf& shelf = page.shelves[region.shelf_idx];
+		if (region.x + region.width == shelf.x) {
+			// last texture of the shelf, give back the column and the free slots that end there
+			shelf.x = region.x;
+			bool merged = true;
+			while (merged) {
+				merged = false;
+				for (size_t i = 0; i < shelf.free_slots.size(); i++) {
+					if (shelf.free_slots[i].x + shelf.free_slots[i].y == shelf.x) {
+						shelf.x = shelf.free_slots[i].x;
+						shelf.free_slots.erase(shelf.free_slots.begin() + i);
+						merged = true;
+						break;
+					}
+				}
+			}
+		} else {
+			shelf.free_slots.push_back({ region.x, region.width });
+		}
+	}
+
+	void atlas_flush() {
+		for (atlas_page& page : g_atlas.pages) {
+			if (!page.dirty || page.image.id == 0) {
+				continue;
+			}
+			sg_image_data data = { 0 };
+			data.subimage[0][0] = { .ptr = page.pixels.data(), .size = page.pixels.size() };
+			sg_update_image(page.image, data);
+			page.dirty = false;
+		}
+	}
+
+	void atlas_deinit() {
+		for (atlas_page& page : g_atlas.pages) {
+			if (page.image.id != 0) {
+				sg_destroy_image(page.image);
+			}
+		}
+		g_atlas.pages.clear();
+	}
+}
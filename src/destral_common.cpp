@@ -1,11 +1,13 @@
 #include <destral/destral_common.h>
 #include <fstream>
 #include <chrono>
+#include <mutex>
 
 
 namespace ds::log {
 
     static std::ofstream g_logfile;
+    static std::mutex g_log_mutex; // log can be called from multiple threads (worlds simulation)
 
     void msg(level log_level, const char* file, int line, const std::string_view& msg) {
 
@@ -47,6 +49,7 @@ namespace ds::log {
         char time_str[256];
         std::strftime(time_str, 256, "%Y-%m-%d %H:%M:%S", &tm_t);
         std::string full_msg = std::format("{}.{:0>3} {} {}:{} {}\n", time_str, now_milis.count(), lvl_char, file_name, line, msg);
+        std::lock_guard<std::mutex> lock(g_log_mutex);
         std::printf("%s", full_msg.c_str());
         std::fflush(stdout);  // We can setvbuf(stdout, NULL, _IONBF, 0);  to disable buffering entirely
         if (g_logfile) {
@@ -81,6 +81,12 @@
 #include "backends/destral_platform_backend.h"
 
 #include <unordered_map>
+#include <map>
+#include <deque>
+#include <tuple>
+#include <atomic>
+#include <thread>
+#include <cstring>
 
 namespace ds {
     struct cp_storage {
@@ -91,6 +97,7 @@ namespace ds {
         registry::component_cleanup_fn* cleanup_fn = nullptr;
         registry::component_placementnew_fn* placementnew_fn = nullptr;
         registry::component_delete_fn* delete_fn = nullptr;
+        registry::component_move_fn* move_fn = nullptr;
         i32 cp_id = 0; /* component id for this storage */
 
         /*  packed component elements array. aligned with dense */
@@ -224,14 +231,39 @@ namespace ds {
     struct system_type {
         std::string name;
         registry::system_update_fn* update_fn = nullptr;
+        registry::system_policy policy;
+        i32 tick_count = 0; // every_n_ticks executions counter
+        double last_run_ms = -1; // target_hz last run time (-1 never executed)
+        registry::system_slice slice; // time_sliced state
     };
 
+    struct system_queue {
+        std::string name;
+        ds::darray<system_type> systems;
+    };
+
+#if DS_ECS_VIEW_PROFILING
+    // Profiling record for a view call site
+    struct view_profile {
+        registry::view_stats total; // accumulated since the last view_stats_reset
+        registry::view_stats run; // accumulated during the current system run
+        i64 run_id = -1; // system run that the run stats belong to
+    };
+#endif
+
     struct registry_impl {
-        /* contains all the created entities */
+        /* contains all the created entities.
+           A released slot is stored as { id: 0, version: next version }
+           A reserved (but not yet constructed) slot is stored as { id: -id, version: version } */
         ds::darray<entity> entities;
 
-        /* first index in the list to recycle */
-        i32 available_id = 0;
+        /* stack of released entity ids available to recycle */
+        ds::darray<i32> free_ids;
+
+        /* reservation cursor over free_ids (see entity_reserve)
+           cursor > 0: free_ids[cursor - 1] is the next id to reserve
+           cursor <= 0: the next reserved id is a brand new one (entities.size() + 1 - cursor) */
+        std::atomic<i64> free_cursor = 0;
 
         /* Hold the component storages */
         std::unordered_map<i32, cp_storage> cp_storages;
@@ -252,12 +284,38 @@ namespace ds {
         ds::darray<ctx_variable_info*> ctx_vars_ordered;
 
 
-        // Systems
-        std::unordered_map<std::string, ds::darray<system_type>> system_queues;
+        // Systems queues, the map holds the index of the queue in the array (the system_queue_handle)
+        // A deque keeps the queues in place when a running system adds a new queue
+        std::unordered_map<std::string, i32> system_queues_idx;
+        std::deque<system_queue> system_queues;
+        // System being executed by system_queue_run (running_sys_idx is -1 if none).
+        // It is an index because a running system can add systems to its own queue (reallocating it).
+        system_queue* running_queue = nullptr;
+        i32 running_sys_idx = -1;
+        // Thread running the systems (default id if none), read by other registries in entity_migrate
+        std::atomic<std::thread::id> running_thread;
 
         // Indicates if an entity_make has finished correctly
         // Example: You can't call entity_make_begin again before calling entity_make_end
         bool entity_make_finished = true;
+
+#if DS_ECS_VIEW_PROFILING
+        // Views profiling records, the key is the call site (file, line), the components and the system name.
+        // The records are never freed (the live views point to them), view_stats_reset only clears the counters.
+        std::map<std::tuple<std::string, u32, std::string, std::string>, view_profile> view_profiles;
+        // Records of each view call site (file name pointer, line, column), one per running system and components
+        struct view_call_site {
+            const system_queue* queue;
+            i32 sys_idx;
+            std::vector<const char*> cp_ids;
+            view_profile* profile;
+        };
+        std::map<std::tuple<const char*, u32, u32>, std::vector<view_call_site>> view_call_sites;
+        // Records touched during the current system run
+        ds::darray<view_profile*> view_profiles_run;
+        // Current system run identifier
+        i64 view_profiles_run_id = 0;
+#endif
     };
 
 
@@ -303,22 +361,49 @@ namespace ds {
     static constexpr u32 s_entity_max_version() { return std::numeric_limits<u32>::max(); }
 
 
+    // Moves all the ids handed out by entity_reserve since the last flush to the entities array as reserved slots.
+    // After this the free_ids stack and the reservation cursor are in sync again.
+    // IMPORTANT: Main thread only, and never while other threads are reserving entities.
+    static void s_flush_reserved_entities(registry_impl* r) {
+        const i64 cursor = r->free_cursor.load(std::memory_order_relaxed);
+        const i32 free_len = r->free_ids.size();
+        if (cursor == free_len) {
+            return; // nothing reserved since the last flush
+        }
+
+        // Reserved recycled ids are the top of the free ids stack
+        const i32 first_reserved = (i32)std::max<i64>(cursor, 0);
+        for (i32 i = first_reserved; i < free_len; ++i) {
+            const i32 id = r->free_ids[i];
+            r->entities[id - 1].id = -id;
+        }
+        r->free_ids.resize(first_reserved, 0);
+
+        // Reserved brand new ids
+        if (cursor < 0) {
+            dsverifym(r->entities.size() - cursor <= s_entity_max_id(), "Can't create more entities!");
+            for (i64 i = 0; i < -cursor; ++i) {
+                const i32 id = r->entities.size() + 1;
+                r->entities.push_back(entity{ .id = -id, .version = 1, .type_id = 0 });
+            }
+        }
+        r->free_cursor.store(r->free_ids.size(), std::memory_order_relaxed);
+    }
+
     // Performs the release of an entity in the registry by adding it to the recycle list
     static inline void s_release_entity(registry_impl* r, entity e) {
+        s_flush_reserved_entities(r);
         if (e.version == s_entity_max_version()) {
             // This entity can't be used anymore
-            // set the version to 0 for this handler
+            // set the version to 0 for this handler and never recycle it
             DS_TRACE(std::format("{} Entity released (id invalidated by max version)", e.to_string()) );
-            e.version = 0; // invalidate the entity;
-            r->entities[e.id - 1] = e;
+            r->entities[e.id - 1] = entity{ .id = 0, .version = 0, .type_id = 0 };
         } else {
             // Increment the version of that entity and add the entity to the recycle list
             DS_TRACE(std::format("{} Entity released", e.to_string()));
-            const i32 first_available_id = e.id;
-            e.id = r->available_id; // this will set the "next" id available here
-            e.version++;
-            r->entities[first_available_id - 1] = e;
-            r->available_id = first_available_id;
+            r->entities[e.id - 1] = entity{ .id = 0, .version = e.version + 1, .type_id = 0 };
+            r->free_ids.push_back(e.id);
+            r->free_cursor.store(r->free_ids.size(), std::memory_order_relaxed);
         }
     }
 
@@ -326,7 +411,8 @@ namespace ds {
     // recycling an entity id or by creating a new one if no available for recycling.
     static inline entity s_create_entity(registry* rr, i32 type_idx) {
         registry_impl* r = rr->_r;
-        if (r->available_id == 0) {
+        s_flush_reserved_entities(r);
+        if (r->free_ids.empty()) {
             // Generate a new entity
             // Verify if we can create more entities or not
             dsverifym(r->entities.size() < s_entity_max_id(), "Can't create more entities!");
@@ -339,15 +425,14 @@ namespace ds {
         } else {
             // Recycle an entity
 
-            // get the first available entity id
-            const i32 id = r->available_id;
-            const u32 ver = r->entities[id - 1].version;
-            // point the available_id to the "next" id that is saved in the available_id
-            r->available_id = r->entities[id - 1].id;
+            // get the last released entity id, the slot holds the version to use
+            const i32 id = r->free_ids.back();
+            r->free_ids.pop_back();
+            r->free_cursor.store(r->free_ids.size(), std::memory_order_relaxed);
             // now join the id and version and type idx to create the new entity
             entity e;
             e.id = id;
-            e.version = ver;
+            e.version = r->entities[id - 1].version;
             e.type_id = type_idx;
             // assign it to the entities array
             r->entities[id - 1] = e;
@@ -394,6 +479,30 @@ namespace ds {
         return type;
     }
 
+    // Emplaces and constructs all the components of the entity type for a created entity
+    static void s_construct_components(registry* r, entity e) {
+        const i32 entity_type_id = r->_r->entity_hashed_types[e.type_id];
+        entity_type* type = &r->_r->types[entity_type_id];
+        for (i32 i = 0; i < type->cp_ids.size(); ++i) {
+            const i32 cp_id = type->cp_ids[i];
+            auto st = s_try_get_storage(r, cp_id);
+            dsverify(st);
+
+            // 0 -> Emplace the component to the storage (only reserves memory) like a malloc
+            void* cp_data = st->emplace(e);
+
+            // 1 -> Call placement new to construct the component
+            if (st->placementnew_fn) {
+                st->placementnew_fn(cp_data);
+            }
+
+            // 2 -> Call serialize function for that component
+            if (st->serialize_fn) {
+                st->serialize_fn(r, e, cp_data, true);
+            }
+        }
+    }
+
     void registry::entity_register(const char* ename, const ds::darray<std::string>& cp_names, 
         registry::entity_init_fn* init_fn, registry::entity_deinit_fn* deinit_fn) {
         dsverify(ename);
@@ -432,28 +541,61 @@ namespace ds {
         entity e = s_create_entity(this, type_idx);
 
         // Emplace all the components
-        entity_type* type = &_r->types[entity_type_id];
-        for (i32 i = 0; i < type->cp_ids.size(); ++i) {
-            const i32 cp_id = type->cp_ids[i];
-            auto st = s_try_get_storage(this, cp_id);
-            dsverify(st);
-
-            // 0 -> Emplace the component to the storage (only reserves memory) like a malloc
-            void* cp_data = st->emplace(e);
+        s_construct_components(this, e);
+        return e;
+    }
 
-            // 1 -> Call placement new to construct the component
-            if (st->placementnew_fn) {
-                st->placementnew_fn(cp_data);
-            }
+    entity registry::entity_reserve(const char* entity_name) {
+        dscheck(entity_name != nullptr);
+        const i32 entity_type_id = ds::fnv1a_32bit(entity_name);
+        dscheckm(_r->types.contains(entity_type_id), std::format("Entity name: {} is not a registered one!", entity_name));
+        const i32 type_idx = s_get_entity_type_idx(this, entity_type_id);
 
-            // 2 -> Call serialize function for that component
-            if (st->serialize_fn) {
-                st->serialize_fn(this, e, cp_data, true);
-            }
+        // Each reservation owns a unique cursor position, the free_ids and entities arrays are only read here.
+        const i64 cursor = _r->free_cursor.fetch_sub(1, std::memory_order_relaxed);
+        entity e;
+        e.type_id = type_idx;
+        if (cursor > 0) {
+            // Recycle a released id
+            e.id = _r->free_ids[(i32)cursor - 1];
+            e.version = _r->entities[e.id - 1].version;
+        } else {
+            // Brand new id after the ones already reserved
+            const i64 new_id = (i64)_r->entities.size() + 1 - cursor;
+            dsverifym(new_id <= s_entity_max_id(), "Can't create more entities!");
+            e.id = (i32)new_id;
+            e.version = 1;
         }
         return e;
     }
 
+    void registry::entity_make_reserved_begin(entity e) {
+        dscheck(_r->entity_make_finished);
+        _r->entity_make_finished = false;
+        s_flush_reserved_entities(_r);
+        const entity reserved_slot = { .id = -e.id, .version = e.version, .type_id = 0 };
+        const bool is_reserved = (e.id > 0) && (e.id <= _r->entities.size()) && (_r->entities[e.id - 1] == reserved_slot);
+        dsverifym(is_reserved, std::format("{} is not a reserved entity.", e.to_string()));
+        dscheck(e.type_id < _r->entity_hashed_types.size());
+
+        // The reserved slot becomes a created entity
+        _r->entities[e.id - 1] = e;
+        s_construct_components(this, e);
+    }
+
+    void registry::entity_make_reserved(entity e) {
+        entity_make_reserved_begin(e);
+        entity_make_end(e);
+    }
+
+    void registry::entity_release_reserved(entity e) {
+        s_flush_reserved_entities(_r);
+        const entity reserved_slot = { .id = -e.id, .version = e.version, .type_id = 0 };
+        const bool is_reserved = (e.id > 0) && (e.id <= _r->entities.size()) && (_r->entities[e.id - 1] == reserved_slot);
+        dsverifym(is_reserved, std::format("{} is not a reserved entity.", e.to_string()));
+        s_release_entity(_r, e);
+    }
+
     void registry::entity_make_end(entity e) {
         dscheck(!_r->entity_make_finished);
         _r->entity_make_finished = true;
@@ -514,6 +656,60 @@ namespace ds {
         s_release_entity(_r, e);
     }
 
+    // Returns true if a thread other than the calling one is running systems of the registry
+    static bool s_running_in_other_thread(registry_impl* r) {
+        const std::thread::id running = r->running_thread.load();
+        return running != std::thread::id() && running != std::this_thread::get_id();
+    }
+
+    entity registry::entity_migrate(entity e, registry* dst) {
+        dscheck(dst && dst != this);
+        dsverifym(!s_running_in_other_thread(_r) && !s_running_in_other_thread(dst->_r),
+            "entity_migrate can't be used while other threads are running systems of the source or destination registries.");
+        dscheck(dst->_r->entity_make_finished);
+        dsverifym(entity_valid(e), std::format("{} is not valid and can't be migrated.", e.to_string()));
+        entity_type* type = s_get_entity_type(this, e);
+        dsverifym(dst->_r->types.contains(type->type_id), std::format("Entity type: {} is not registered in the destination registry.", type->name));
+        entity_type* dst_type = &dst->_r->types[type->type_id];
+        bool same_cps = (dst_type->cp_ids.size() == type->cp_ids.size());
+        for (i32 i = 0; same_cps && i < type->cp_ids.size(); ++i) {
+            same_cps = (dst_type->cp_ids[i] == type->cp_ids[i]);
+        }
+        dsverifym(same_cps, std::format("Entity type: {} has different components in the destination registry.", type->name));
+
+        // Create the entity in the destination registry
+        entity dst_e = s_create_entity(dst, s_get_entity_type_idx(dst, type->type_id));
+
+        // Move the components in registration order (storage order is not relevant here)
+        for (i32 i = 0; i < type->cp_ids.size(); ++i) {
+            const i32 cp_id = type->cp_ids[i];
+            cp_storage* st = s_get_storage(this, cp_id);
+            cp_storage* dst_st = s_get_storage(dst, cp_id);
+            dsverify(st->cp_sizeof == dst_st->cp_sizeof);
+            dsverifym(st->move_fn || !st->placementnew_fn, std::format("Component: {} can't be migrated, it is not move constructible.", st->name));
+
+            void* src_data = st->get(e);
+            void* dst_data = dst_st->emplace(dst_e);
+
+            // 1 -> Move construct the component (raw components without constructor are just copied)
+            if (st->move_fn) {
+                st->move_fn(dst_data, src_data);
+            } else {
+                memcpy(dst_data, src_data, st->cp_sizeof);
+            }
+
+            // 2 -> Call destructor for the moved from component and remove it from the storage
+            if (st->delete_fn) {
+                st->delete_fn(src_data);
+            }
+            st->remove(e);
+        }
+
+        // 3 -> release the entity in this registry
+        s_release_entity(_r, e);
+        return dst_e;
+    }
+
     void* registry::component_get(entity e, const char* cp_name) {
         dscheck(entity_valid(e));
         const i32 cp_id = ds::fnv1a_32bit(cp_name);
@@ -529,7 +725,7 @@ namespace ds {
 
     bool registry::entity_valid(entity e) {
         if (e == entity_null) return false;
-        return (e.id <= _r->entities.size() ) && ( _r->entities[e.id - 1] == e );
+        return (e.id > 0) && (e.id <= _r->entities.size() ) && ( _r->entities[e.id - 1] == e );
     }
 
     bool registry::entity_is_name(entity e, const char* entity_name) {
@@ -543,26 +739,22 @@ namespace ds {
     }
 
     ds::darray<entity> registry::entity_all() {
-        // If no entities are available to recycle, means that the full vector is valid
-        if (_r->available_id == 0) {
-            return _r->entities;
-        } else {
-            ds::darray<entity> alive;
-            for (i32 i = 0; i < _r->entities.size(); ++i) {
-                entity e = _r->entities[i];
-                
-                // if the entity id minus 1 is the same as the index, means its not a recycled one
-                if ((e.id - 1) == i) {
-                    alive.push_back(e);
-                }
+        ds::darray<entity> alive;
+        for (i32 i = 0; i < _r->entities.size(); ++i) {
+            entity e = _r->entities[i];
+
+            // if the entity id minus 1 is the same as the index, means its not a released or reserved one
+            if ((e.id - 1) == i) {
+                alive.push_back(e);
             }
-            return alive;
         }
+        return alive;
     }
 
     void registry::component_register(const char* cp_name, i32 cp_sizeof, 
         component_serialize_fn* srlz_fn, component_cleanup_fn* cleanup_fn,
-        component_placementnew_fn* placementnew_fn, component_delete_fn* delete_fn)
+        component_placementnew_fn* placementnew_fn, component_delete_fn* delete_fn,
+        component_move_fn* move_fn)
     {
         dscheck(cp_name);
         const auto cp_id = ds::fnv1a_32bit(cp_name);
@@ -573,6 +765,7 @@ namespace ds {
         cp_st.cleanup_fn = cleanup_fn;
         cp_st.placementnew_fn = placementnew_fn;
         cp_st.delete_fn = delete_fn;
+        cp_st.move_fn = move_fn;
         cp_st.cp_sizeof = cp_sizeof;
         cp_st.name = cp_name;
         _r->cp_storages[cp_id] = cp_st;
@@ -602,36 +795,132 @@ namespace ds {
         _r->entities_to_destroy.clear();
     }
 
+    registry::system_queue_handle registry::system_queue_get(const char* queue_name) {
+        dscheck(queue_name);
+        auto found = _r->system_queues_idx.find(queue_name);
+        if (found != _r->system_queues_idx.end()) {
+            return { .idx = found->second };
+        }
+        const i32 idx = _r->system_queues.size();
+        _r->system_queues.push_back(system_queue{ .name = queue_name });
+        _r->system_queues_idx[queue_name] = idx;
+        return { .idx = idx };
+    }
+
     void registry::system_queue_add(const char* queue_name, const char* sys_name, system_update_fn* sys_update_fn) {
+        system_queue_add(queue_name, sys_name, sys_update_fn, system_policy::always());
+    }
+
+    void registry::system_queue_add(const char* queue_name, const char* sys_name, system_update_fn* sys_update_fn, const system_policy& policy) {
         dscheck(queue_name);
         dscheck(sys_name);
-        for (i32 i = 0; i < _r->system_queues[queue_name].size(); i++) {
-            dsverifym(_r->system_queues[queue_name][i].name != sys_name, std::format("System name: {} is duplicated.", sys_name));
+        dsverifym(policy.run_mode != system_policy::mode::every_n_ticks || policy.ticks > 0, std::format("System: {} every_n_ticks must be greater than 0.", sys_name));
+        dsverifym(policy.run_mode != system_policy::mode::target_hz || policy.hz > 0, std::format("System: {} target_hz must be greater than 0.", sys_name));
+        auto& systems = _r->system_queues[system_queue_get(queue_name).idx].systems;
+        for (i32 i = 0; i < systems.size(); i++) {
+            dsverifym(systems[i].name != sys_name, std::format("System name: {} is duplicated.", sys_name));
+        }
+        systems.push_back(system_type{ .name = sys_name, .update_fn = sys_update_fn, .policy = policy });
+    }
+
+    // Returns true if the system policy allows the system to run now
+    static bool s_system_should_run(system_type* sys, double now_ms) {
+        switch (sys->policy.run_mode) {
+        case registry::system_policy::mode::every_n_ticks: {
+            const bool run = (sys->tick_count == 0);
+            sys->tick_count = (sys->tick_count + 1) % sys->policy.ticks;
+            return run;
+        }
+        case registry::system_policy::mode::target_hz: {
+            const double period_ms = 1000.0 / sys->policy.hz;
+            if (sys->last_run_ms >= 0 && (now_ms - sys->last_run_ms) < period_ms) {
+                return false;
+            }
+            // keep the cadence stable, but don't try to catch up if we are too late
+            const bool too_late = (sys->last_run_ms < 0) || ((now_ms - sys->last_run_ms) >= 2.0 * period_ms);
+            sys->last_run_ms = too_late ? now_ms : sys->last_run_ms + period_ms;
+            return true;
+        }
+        case registry::system_policy::mode::time_sliced: {
+            sys->slice.deadline_ms = now_ms + sys->policy.budget_ms;
+            return true;
+        }
+        default:
+            return true;
         }
-        _r->system_queues[queue_name].push_back(system_type(sys_name, sys_update_fn));
     }
 
-    
     registry::sys_queue_run_stats registry::system_queue_run(const char* queue_name) {
         dscheck(queue_name);
+        auto found = _r->system_queues_idx.find(queue_name);
+        if (found == _r->system_queues_idx.end()) {
+            sys_queue_run_stats queue_stats;
+            queue_stats.queue_name = queue_name;
+            return queue_stats;
+        }
+        return system_queue_run(system_queue_handle{ .idx = found->second });
+    }
+
+    // Returns the system being executed by system_queue_run (nullptr if none)
+    static system_type* s_running_system(registry_impl* r) {
+        return r->running_sys_idx >= 0 ? &r->running_queue->systems[r->running_sys_idx] : nullptr;
+    }
+
+    registry::sys_queue_run_stats registry::system_queue_run(system_queue_handle queue) {
+        dsverifym(queue.idx >= 0 && queue.idx < (i32)_r->system_queues.size(), "Invalid system queue handle.");
+        // a queue can be run from a system, the running system is restored after each system
+        system_queue* const outer_queue = _r->running_queue;
+        const i32 outer_sys_idx = _r->running_sys_idx;
         sys_queue_run_stats queue_stats;
-        queue_stats.queue_name = queue_name;
-        if (_r->system_queues.contains(queue_name)) {
-            auto& sys_list = _r->system_queues[queue_name];
-            for (i32 i = 0; i < sys_list.size(); i++) {
-                auto last = platform_backend::get_performance_counter_miliseconds();
-                if (sys_list[i].update_fn) {
-                    sys_list[i].update_fn(this);
-                    entity_destroy_flush_delayed();
-                }
-                auto now = platform_backend::get_performance_counter_miliseconds();
-                queue_stats.sys_stats.push_back(
-                    { .sys_name = sys_list[i].name, .miliseconds = std::max(0.0, now - last) });
+        queue_stats.queue_name = _r->system_queues[queue.idx].name;
+        // the systems are accessed by index, a running system can add systems to the queue
+        auto& sys_list = _r->system_queues[queue.idx].systems;
+        for (i32 i = 0; i < sys_list.size(); i++) {
+            auto last = platform_backend::get_performance_counter_miliseconds();
+            if (!s_system_should_run(&sys_list[i], last)) {
+                queue_stats.sys_stats.push_back({ .sys_name = sys_list[i].name, .miliseconds = 0, .executed = false });
+                continue;
+            }
+#if DS_ECS_VIEW_PROFILING
+            _r->view_profiles_run_id++;
+#endif
+            _r->running_queue = &_r->system_queues[queue.idx];
+            _r->running_sys_idx = i;
+            _r->running_thread.store(std::this_thread::get_id());
+            if (sys_list[i].update_fn) {
+                sys_list[i].update_fn(this);
+                entity_destroy_flush_delayed();
             }
+            _r->running_queue = outer_queue;
+            _r->running_sys_idx = outer_sys_idx;
+            if (outer_sys_idx < 0) {
+                _r->running_thread.store(std::thread::id());
+            }
+            auto now = platform_backend::get_performance_counter_miliseconds();
+            queue_stats.sys_stats.push_back(
+                { .sys_name = sys_list[i].name, .miliseconds = std::max(0.0, now - last) });
+#if DS_ECS_VIEW_PROFILING
+            for (i32 j = 0; j < _r->view_profiles_run.size(); j++) {
+                queue_stats.sys_stats.back().views.push_back(_r->view_profiles_run[j]->run);
+            }
+            _r->view_profiles_run.clear();
+#endif
         }
         return queue_stats;
     }
 
+    registry::system_slice* registry::system_slice_current() {
+        system_type* sys = s_running_system(_r);
+        if (sys && sys->policy.run_mode == system_policy::mode::time_sliced) {
+            return &sys->slice;
+        }
+        return nullptr;
+    }
+
+    bool registry::system_slice::out_of_budget() {
+        return platform_backend::get_performance_counter_miliseconds() >= deadline_ms;
+    }
+
     void* registry::ctx_set(const char* ctx_name_id, void* instance_ptr, void (*del_fn)(void* ptr)) {
         dscheck(ctx_name_id != nullptr);
         dscheck(instance_ptr);
@@ -695,9 +984,18 @@ namespace ds {
     //--------------------------------------------------------------------------------------------------
     // Views 
 
+#if DS_ECS_VIEW_PROFILING
+#define DS_VIEW_PROFILE_CODE(code) do { code; } while (false)
+#else
+#define DS_VIEW_PROFILE_CODE(code)
+#endif
+
     // Returns true if the entity e is in all storages
-    static bool s_view_is_entity_in_all_storages(view* v, ds::entity e) {
+    // probes is incremented by the number of storages checked (only when profiling)
+    static bool s_view_is_entity_in_all_storages(view* v, ds::entity e, i64* probes) {
+        (void)probes;
         for (i32 st_id = 0; st_id < v->_impl.cp_storages.size(); ++st_id) {
+            DS_VIEW_PROFILE_CODE((*probes)++);
             if (!v->_impl.cp_storages[st_id]->contains(e)) {
                 return false;
             }
@@ -705,8 +1003,111 @@ namespace ds {
         return true;
     }
 
-    view registry::view_create(const ds::darray<const char*>& cp_ids) {
+#if DS_ECS_VIEW_PROFILING
+    // Returns true if the view components are the same strings (usually the same literals) than the cached ones
+    static bool s_view_same_components(const std::vector<const char*>& cached, const ds::darray<const char*>& cp_ids) {
+        if (cached.size() != (size_t)cp_ids.size()) {
+            return false;
+        }
+        for (i32 i = 0; i < cp_ids.size(); i++) {
+            if (cached[i] != cp_ids[i] && std::strcmp(cached[i], cp_ids[i]) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Returns the profiling record for the view call site inside the running system.
+    // The records are cached per call site, the names are only formatted the first time a call site is used by a system.
+    static view_profile* s_view_profile_get(registry_impl* r, const std::source_location& call_site, const ds::darray<const char*>& cp_ids) {
+        const system_type* running_sys = s_running_system(r);
+        auto& sites = r->view_call_sites[{ call_site.file_name(), call_site.line(), call_site.column() }];
+        view_profile* p = nullptr;
+        for (const registry_impl::view_call_site& site : sites) {
+            if (site.queue == r->running_queue && site.sys_idx == r->running_sys_idx && s_view_same_components(site.cp_ids, cp_ids)) {
+                p = site.profile;
+                break;
+            }
+        }
+        if (!p) {
+            // First time we see this call site in the running system, find or create the record
+            const std::string sys_name = running_sys ? running_sys->name : std::string();
+            std::string cp_names;
+            for (i32 i = 0; i < cp_ids.size(); i++) {
+                cp_names += (i == 0) ? cp_ids[i] : std::format(", {}", cp_ids[i]);
+            }
+            p = &r->view_profiles[{ call_site.file_name(), call_site.line(), cp_names, sys_name }];
+            if (p->total.call_site.empty()) {
+                p->total.call_site = std::format("{}:{}", call_site.file_name(), call_site.line());
+                p->total.sys_name = sys_name;
+                p->total.cp_names = cp_names;
+            }
+            registry_impl::view_call_site& site = sites.emplace_back(registry_impl::view_call_site{ .queue = r->running_queue, .sys_idx = r->running_sys_idx, .profile = p });
+            for (i32 i = 0; i < cp_ids.size(); i++) {
+                site.cp_ids.push_back(cp_ids[i]);
+            }
+        }
+        if (p->run_id != r->view_profiles_run_id) {
+            // First time used in this system run
+            p->run_id = r->view_profiles_run_id;
+            p->run = registry::view_stats{ .call_site = p->total.call_site, .cp_names = p->total.cp_names, .sys_name = p->total.sys_name };
+            if (running_sys) {
+                r->view_profiles_run.push_back(p);
+            }
+        }
+        return p;
+    }
+
+    // Adds the iteration counters to the view profiling record, the time is added once when the view becomes invalid
+    static void s_view_profile_add(view* v, i64 visited, i64 accepted, i64 probes) {
+        double ms = 0;
+        if (!v->valid() && v->_impl.profile_start >= 0) {
+            ms = std::max(0.0, platform_backend::get_performance_counter_miliseconds() - v->_impl.profile_start);
+            v->_impl.profile_start = -1;
+        }
+        registry::view_stats* stats[] = { &v->_impl.profile->total, &v->_impl.profile->run };
+        for (registry::view_stats* st : stats) {
+            st->entities_visited += visited;
+            st->entities_accepted += accepted;
+            st->storages_probed += probes;
+            st->miliseconds += ms;
+        }
+    }
+#endif
+
+    ds::darray<registry::view_stats> registry::view_stats_get() {
+        ds::darray<view_stats> all;
+#if DS_ECS_VIEW_PROFILING
+        for (auto& p : _r->view_profiles) {
+            if (p.second.total.views_created > 0) { // skip the call sites not used since the last reset
+                all.push_back(p.second.total);
+            }
+        }
+#endif
+        return all;
+    }
+
+    void registry::view_stats_reset() {
+#if DS_ECS_VIEW_PROFILING
+        // the counters are cleared in place, the live views and the current system run point to the records
+        for (auto& p : _r->view_profiles) {
+            p.second.total = registry::view_stats{ .call_site = p.second.total.call_site, .cp_names = p.second.total.cp_names, .sys_name = p.second.total.sys_name };
+        }
+#endif
+    }
+
+    view registry::view_create(const ds::darray<const char*>& cp_ids, std::source_location call_site) {
         view view;
+        i64 probes = 0;
+#if DS_ECS_VIEW_PROFILING
+        view._impl.profile_start = platform_backend::get_performance_counter_miliseconds();
+        view._impl.profile = s_view_profile_get(_r, call_site, cp_ids);
+        view._impl.profile->total.views_created++;
+        view._impl.profile->run.views_created++;
+        i64 visited = 0;
+#else
+        (void)call_site;
+#endif
         // Retrieve all the system storages for component ids for this system
         // and find the shorter storage (the one with less entities to iterate)
         for (i32 cp_id_idx = 0; cp_id_idx < cp_ids.size(); ++cp_id_idx) {
@@ -734,17 +1135,41 @@ namespace ds {
         for (i32 i = 0; i < view._impl.iterating_storage->dense.size(); ++i) {
             view._impl.entity_index = i;
             auto e = view._impl.iterating_storage->dense[i];
+            DS_VIEW_PROFILE_CODE(visited++);
             if (e != entity_null) {
-                if (s_view_is_entity_in_all_storages(&view, e)) {
+                if (s_view_is_entity_in_all_storages(&view, e, &probes)) {
                     view._impl.cur_entity = view._impl.iterating_storage->dense[i];
                     break;
                 }
             }
         }
 
+#if DS_ECS_VIEW_PROFILING
+        s_view_profile_add(&view, visited, view.valid() ? 1 : 0, probes);
+#endif
         return view;
     }
 
+    void view::seek(i32 cursor) {
+        i64 probes = 0;
+#if DS_ECS_VIEW_PROFILING
+        i64 visited = 0;
+#endif
+        _impl.cur_entity = entity_null;
+        for (i32 i = std::max(cursor, 0); i < _impl.entity_max_index; ++i) {
+            _impl.entity_index = i;
+            auto e = _impl.iterating_storage->dense[i];
+            DS_VIEW_PROFILE_CODE(visited++);
+            if (s_view_is_entity_in_all_storages(this, e, &probes)) {
+                _impl.cur_entity = e;
+                break;
+            }
+        }
+#if DS_ECS_VIEW_PROFILING
+        s_view_profile_add(this, visited, valid() ? 1 : 0, probes);
+#endif
+    }
+
     // Returns the component index associated with a component id (use data function to retrieve the data)
     i32 view::index(const char* cp_name) {
         const i32 cp_id_hashed = fnv1a_32bit(cp_name);
@@ -767,6 +1192,10 @@ namespace ds {
     // Advances the next entity that has all the components for the view
     void view::next() {
         dscheck(valid());
+        i64 probes = 0;
+#if DS_ECS_VIEW_PROFILING
+        i64 visited = 0;
+#endif
         // find the next contained entity that is inside all pools
         bool entity_contained = false;
         do {
@@ -774,12 +1203,16 @@ namespace ds {
                 // select next entity from the iterating storage (smaller one..)
                 ++_impl.entity_index;
                 _impl.cur_entity = _impl.iterating_storage->dense[_impl.entity_index];
+                DS_VIEW_PROFILE_CODE(visited++);
                 // now check if the entity is contained in ALL other storages:
-                entity_contained = s_view_is_entity_in_all_storages(this, _impl.cur_entity);
+                entity_contained = s_view_is_entity_in_all_storages(this, _impl.cur_entity, &probes);
             } else {
                 _impl.cur_entity = entity_null;
             }
         } while ((_impl.cur_entity != entity_null) && !entity_contained);
+#if DS_ECS_VIEW_PROFILING
+        s_view_profile_add(this, visited, valid() ? 1 : 0, probes);
+#endif
     }
 
    
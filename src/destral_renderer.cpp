@@ -3,8 +3,15 @@
 #include <destral/destral_ecs.h>
 #include <destral/thirdparty/ap_gl33core.h>
 #include <destral/destral_texture.h>
+#include <destral/destral_atlas.h>
 #include <unordered_map>
-#include <map>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cfloat>
+#include <string>
 
 #include "thirdparty/SDL_ttf.h"
 
@@ -33,10 +40,9 @@ namespace ds::ttf {
 }
 
 
-// Current limitations
-// * There can be only one camera, check render_set_camera, 
-//		Why? because sg_update_buffer can't be updated inside the same frame.
-//		Whe should use sg_append_buffer but it's not implemented now.
+// Multiple cameras:
+// The vertex data is appended once per frame to the streaming buffers (see stream_buffer) in world space,
+// then each camera draws all the batches in its own pass with its viewport, scissor and view projection uniform.
 
 namespace ds {
 	
@@ -48,18 +54,155 @@ namespace ds {
 
 
 
-	struct mesh_data {
-		sg_bindings bind = { 0 };
-		int vertex_start = 0;
-		int vertex_count = 0;
+	// Pipeline slots used in the draw commands keys (max 16)
+	enum pipeline_slot : u32 {
+		PIPELINE_TRIS = 0,
+		PIPELINE_LINES, // thick lines stream
+		PIPELINE_QUADS, // indexed quads stream
+		PIPELINE_QUADS_TEXTURED, // indexed quads stream
+		PIPELINE_SPRITES, // instanced sprites stream
+		PIPELINE_SHAPES, // instanced sdf shapes stream
+		PIPELINE_SPRITES_OPAQUE, // instanced sprites stream, alpha tested and writing the depth (see renderer_state::depth_mode)
+		PIPELINE_COUNT,
+		PIPELINE_RETAINED_LAYER = 0xF // not a pipeline: draws the batches of retained layers (see layer_draw)
+	};
+
+	// Returns true if the pipeline draws the quads stream (the draw ranges are indices instead of vertices)
+	static constexpr bool s_is_quads_pipeline(u32 pip) { return pip == PIPELINE_QUADS || pip == PIPELINE_QUADS_TEXTURED; }
+
+	// Returns true if the pipeline draws the sprites stream
+	static constexpr bool s_is_sprites_pipeline(u32 pip) { return pip == PIPELINE_SPRITES || pip == PIPELINE_SPRITES_OPAQUE; }
+
+	// Draw command key layout (most significant bits first), sorting the keys gives the draw order:
+	// | translucent: 1 | layer: 4 | depth (biased): 16 | pipeline slot: 4 | texture slot: 16 | submission index: 23 |
+	// The opaque draws (depth mode only) have the translucent bit cleared and the layer and depth inverted,
+	// so they are drawn first and front to back.
+	static constexpr u64 DRAW_KEY_TRANSLUCENT_SHIFT = 63;
+	static constexpr u64 DRAW_KEY_LAYER_SHIFT = 59;
+	static constexpr u64 DRAW_KEY_DEPTH_SHIFT = 43;
+	static constexpr u64 DRAW_KEY_PIPELINE_SHIFT = 39;
+	static constexpr u64 DRAW_KEY_TEXTURE_SHIFT = 23;
+	static constexpr u64 DRAW_KEY_SUBMISSION_MASK = (1ull << 23) - 1;
+	static constexpr u32 DRAW_KEY_DEPTH_INDEX_MASK = 0xFFFFF; // layer and depth bits
+
+	// Packed vertex of the tris, lines and quads streams (16 bytes)
+	struct vertex {
+		float x, y;
+		u32 color; // RGBA8
+		u16 u, v; // normalized uvs
+	};
+	static_assert(sizeof(vertex) == 16, "vertex must be 16 bytes");
+
+	// Vertex of the thick lines stream, the offset is expanded by the half width in the vertex shader
+	struct line_vertex {
+		float x, y; // polyline point
+		float offset_x, offset_y; // join/cap offset in half width units
+		u32 color; // RGBA8
+		float half_width; // > 0 world units, < 0 pixels
+	};
+	static_assert(sizeof(line_vertex) == 24, "line_vertex must be 24 bytes");
+
+	// Instance of the sprites pipeline, the unit quad is expanded in the vertex shader
+	struct sprite_instance {
+		float affine[6]; // 2x3 affine matrix rows (model * size)
+		u16 uv[4]; // normalized uv rect: top left, bottom right
+		u32 color; // RGBA8
+		float depth; // sort depth (the draw order comes from the draw key)
+	};
+	static_assert(sizeof(sprite_instance) == 40, "sprite_instance must be 40 bytes");
+
+	// Instance of the sdf shapes pipeline: a rounded box in local space (circles, rings, capsules and rounded rects)
+	struct shape_instance {
+		float affine[6]; // 2x3 affine matrix rows (local space to world)
+		float half_size[2]; // box half size in local units
+		float corner_radius; // local units, clamped to the half size (half_size.x == half_size.y == radius is a circle)
+		float thickness; // 0 filled, > 0 outline in local units, < 0 outline in pixels
+		u32 color; // RGBA8
+		float depth; // sort depth (the draw order comes from the draw key)
+	};
+	static_assert(sizeof(shape_instance) == 48, "shape_instance must be 48 bytes");
+
+	// Packs a color to RGBA8 (r is the first byte in memory)
+	static inline u32 s_pack_color(const vec4& c) {
+		const vec4 cc = glm::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f;
+		return (u32)cc.r | ((u32)cc.g << 8) | ((u32)cc.b << 16) | ((u32)cc.a << 24);
+	}
+
+	// Packs a [0, 1] value to an unsigned normalized short
+	static inline u16 s_pack_unorm16(float v) {
+		return (u16)(glm::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+	}
+
+	static inline vertex s_make_vertex(vec2 pos, u32 color, vec2 uv = { 0, 0 }) {
+		return { .x = pos.x, .y = pos.y, .color = color, .u = s_pack_unorm16(uv.x), .v = s_pack_unorm16(uv.y) };
+	}
+
+	// Streaming GPU buffer, a ring of buffers (one per frame) that grow geometrically when the frame data doesn't fit.
+	// The high water mark is used when growing so after some frames the steady state never reallocates.
+	struct stream_buffer {
+		static constexpr i32 RING_SIZE = 3;
+		const char* label = nullptr;
+		sg_buffer buffers[RING_SIZE] = { 0 };
+		size_t capacities[RING_SIZE] = { 0 };
+		i32 ring_idx = 0;
+		size_t high_water_mark = 0; // max bytes uploaded in a frame
+		i32 reallocations = 0;
+
+		// buffer and byte offset of the current frame data (see s_stream_upload)
+		sg_buffer current = { 0 };
+		i32 offset = 0;
+	};
+
+	// vertex_start/vertex_count are index ranges for the quads pipelines and instance ranges for the sprites pipeline
+	struct draw_cmd {
+		u64 key = 0;
+		i32 vertex_start = 0;
+		i32 vertex_count = 0;
+	};
+
+	// Consecutive sorted draw commands with the same state merged in a single draw call
+	struct draw_batch {
+		u32 pipeline_slot = 0;
+		u32 texture_slot = 0;
+		u32 depth_index = 0; // layer and biased depth (its rank in the frame after s_rank_batch_depths), the batches only span one depth in depth mode
+		i32 vertex_start = 0;
+		i32 vertex_count = 0;
+	};
+
+	// Vertex shader uniform block shared by all the pipelines
+	struct vs_params {
+		glm::mat4 view_proj;
+		vec2 viewport_size; // camera viewport size in pixels
+	};
+
+	// Uniforms of the upscale shader: the scene only covers a part of the scene target with dynamic resolution
+	struct upscale_params {
+		vec2 uv_scale;
 	};
 
+	// Sets the vs_params uniform block in the vertex shader description
+	static void s_set_vs_params_desc(sg_shader_desc* desc) {
+		desc->vs.uniform_blocks[0].size = sizeof(vs_params);
+		desc->vs.uniform_blocks[0].uniforms[0] = { .name = "view_proj", .type = SG_UNIFORMTYPE_MAT4 };
+		desc->vs.uniform_blocks[0].uniforms[1] = { .name = "viewport_size", .type = SG_UNIFORMTYPE_FLOAT2 };
+	}
+
+	// Returns the 4x4 matrix equivalent to a 2D affine matrix (the z axis is left untouched).
+	// The third row of the mat3 is ignored: the camera projections cut from glm::ortho have a -1 there.
+	static glm::mat4 s_mat4_from_affine(const mat3& m) {
+		return glm::mat4(
+			m[0].x, m[0].y, 0, 0,
+			m[1].x, m[1].y, 0, 0,
+			0, 0, 1, 0,
+			m[2].x, m[2].y, 0, 1);
+	}
+
 	struct camera_data {
-		camera_data(const vec4& camera_vp, const mat3& camera_ltw, float aspect, float ortho_width) {
+		// vp_size is the size in pixels of the image where the camera renders (see s_scene_size)
+		camera_data(const vec4& camera_vp, const mat3& camera_ltw, float aspect, float ortho_width, vec4 clear_color_, i32 order_, ivec2 vp_size)
+			: clear_color(clear_color_), order(order_) {
 			dsverify(aspect >= 0);
 			const float half_vsize = ortho_width / aspect;
-			ivec2 vp_size;
-			platform_backend::get_drawable_size(&vp_size.x, &vp_size.y);
 			projection_matrix = glm::ortho(-aspect * half_vsize, aspect * half_vsize, -half_vsize, half_vsize);
 			view_matrix = glm::inverse(camera_ltw);
 			scis = { (i32)(camera_vp.x * vp_size.x),
@@ -70,51 +213,299 @@ namespace ds {
 				(i32)(camera_vp.y * vp_size.y),
 				(i32)((camera_vp.z * vp_size.x) - (camera_vp.x * vp_size.x)),
 				(i32)((camera_vp.w * vp_size.y) - (camera_vp.y * vp_size.y)) };
+
+			// world space bounding box of the view rect corners (the projection can't be inverted as an affine matrix,
+			// its third row is the one of glm::ortho)
+			const vec2 half_extents = { aspect * half_vsize, half_vsize };
+			const vec2 corners[] = {
+				camera_ltw * vec3(-half_extents.x, -half_extents.y, 1), camera_ltw * vec3(half_extents.x, -half_extents.y, 1),
+				camera_ltw * vec3(half_extents.x, half_extents.y, 1), camera_ltw * vec3(-half_extents.x, half_extents.y, 1) };
+			world_bounds = { corners[0], corners[0] };
+			for (const vec2& c : corners) {
+				world_bounds.min = glm::min(world_bounds.min, c);
+				world_bounds.max = glm::max(world_bounds.max, c);
+			}
 		}
 		ivec4 vp;
 		ivec4 scis;
 		mat3 projection_matrix;
 		mat3 view_matrix;
+		rect world_bounds;
+		vec4 clear_color; // alpha 0 means don't clear
+		i32 order = 0;
+		i32 clear_vertex_start = 0; // clip space quad used to clear the camera viewport
 	};
 
-	struct renderer_state {
-		sg_shader non_textured_sh = { 0 };
-		sg_shader textured_sh = { 0 };
-		
-		sg_pipeline tris_non_textured_pip = { 0 };
-		sg_pipeline tris_textured_pip = { 0 };
-		sg_pipeline lines_pip = { 0 };
+	// A retained layer submitted to the frame, drawn with the camera view projection multiplied by the model matrix
+	struct layer_draw {
+		u32 layer_idx = 0;
+		u32 version = 0; // the slot can be reused by a new layer while the frame is in flight
+		mat3 model = mat3(1.0f);
+	};
 
-		// -z is inside, z+ is front
-		std::map<i32, std::unordered_map<std::uint32_t /* sg_pipeline */, std::vector<mesh_data> > > render_list;
+	// Immutable data of a presented frame (sorted batches, vertex data and cameras).
+	// With a render thread it is drawn while the game thread submits the next frame.
+	struct frame_packet {
+		std::vector<vertex> vertex_data;
+		std::vector<vertex> quad_vertex_data;
+		std::vector<sprite_instance> sprite_instances;
+		std::vector<shape_instance> shape_instances;
+		std::vector<line_vertex> line_vertex_data;
+		std::vector<layer_draw> layer_draws;
+		std::vector<draw_batch> draw_batches;
+		std::vector<sg_image> textures;
+		std::vector<camera_data> cameras;
+		u32 depth_count = 0; // distinct depths of the batches in depth mode
+		ivec2 scene_size = { 0,0 }; // size of the image where the cameras render
+		bool offscreen = false; // the cameras render to the scene target that is upscaled to the window
+		ivec2 scene_target_size = { 0,0 }; // the scene is rendered in the bottom left corner of the scene target
+		render_frame_stats stats; // submission side stats
+		u64 frame = 0; // number of the presented frame
+		bool quit = false; // stops the render thread
+	};
+
+	// Texture released while the frames in flight can still draw it (see render_texture_release)
+	struct pending_release {
+		u64 frame = 0; // released when this frame (or a later one) has been drawn
+		sg_image image = { .id = 0 };
+		atlas_region atlas_slot;
+		bool atlased = false;
+	};
+
+	// Lock free triple buffer of frame packets: the game thread fills the back packet and publishes it as the middle one,
+	// the render thread takes the middle one when it is new. If the game thread is faster the stale packets are skipped.
+	struct packet_exchange {
+		static constexpr u32 INDEX_MASK = 0x3;
+		static constexpr u32 NEW_BIT = 0x4; // the middle packet was not taken by the render thread
+		std::atomic<u32> middle = 1;
+		u32 back = 0; // owned by the game thread
+		u32 front = 2; // owned by the render thread
+	};
 
-		std::vector<float> vertex_data;
+	// Named sorting layer (see render_sorting_layer_register), the rank is the layer of the draw command keys
+	struct sorting_layer {
+		std::string name;
+		render_sort_mode mode = render_sort_mode::depth;
+		i32 order = 0;
+		float (*sort_key)(vec2 position, i32 depth) = nullptr; // render_sort_mode::custom
+		u32 rank = 0;
+	};
+
+	// Primitives submitted by one thread. Each thread calling the render_* functions writes to its own context without
+	// locks, the contexts of all the threads are merged in render_present.
+	struct submit_context {
+		std::vector<vertex> quad_vertex_data;
+		std::vector<sprite_instance> sprite_instances;
+		std::vector<shape_instance> shape_instances;
+		std::vector<line_vertex> line_vertex_data;
+		std::vector<vec2> line_offsets_tmp; // render_line scratch memory
+		std::vector<layer_draw> layer_draws;
+		std::vector<draw_cmd> draw_cmds;
+		std::vector<float> sort_values; // sort value of each draw command in the y and custom sorting layers
+
+		// Textures used by the context, the index is the texture slot of the context draw commands
+		std::vector<sg_image> textures;
+		std::unordered_map<u32 /* sg_image id */, u32> textures_slot;
+
+		i32 primitives_dropped = 0;
+	};
+
+	// Retained layer: the primitives recorded between render_layer_begin and render_layer_end are sorted into batches
+	// and uploaded once to immutable buffers. Each render_layer_submit only adds a layer_draw to the frame.
+	struct retained_layer {
+		submit_context recording;
+		std::vector<draw_cmd> draw_cmds_sort_tmp;
+		std::vector<draw_batch> batches;
+		std::vector<sg_image> textures;
+		sg_buffer quads_vbo = { 0 };
+		sg_buffer sprites_vbo = { 0 };
+		sg_buffer shapes_vbo = { 0 };
+		sg_buffer lines_vbo = { 0 };
+		bool dirty = true;
+	};
 
-		// Holds the vertex data vertices transformed
-		std::vector<float> vertex_data_transformed;
+	// Buffers and byte offsets of the vertex data referenced by the batches
+	struct batch_sources {
+		struct source {
+			sg_buffer buffer = { 0 };
+			i32 offset = 0;
+		};
+		source tris;
+		source quads;
+		source sprites;
+		source shapes;
+		source lines;
+		const std::vector<sg_image>* textures = nullptr;
+	};
 
-		// Per frame vertex buffer object
-		static constexpr std::size_t MAX_VERTEX_DATA_BYTES_SIZE = 250000 * 4; // Maximum vertex data in the VBO
-		sg_buffer vbo = { 0 };
+	struct renderer_state {
+		sg_shader non_textured_sh = { 0 };
+		sg_shader textured_sh = { 0 };
+		sg_shader sprites_sh = { 0 };
+		sg_shader shapes_sh = { 0 };
+		sg_shader sprites_opaque_sh = { 0 };
+		sg_shader lines_sh = { 0 };
+
+		// no GPU, the primitives are batched and discarded at render_present (app_config::headless)
+		bool headless = false;
+
+		// Depth mode (app_config::depth_opaque_pass): the opaque sprites are drawn first, front to back, writing the
+		// depth buffer and the rest of the primitives are drawn back to front with the depth test (see s_depth_to_z)
+		bool depth_mode = false;
+		std::vector<u32> depth_ranks; // distinct depth indices of the frame batches (see s_rank_batch_depths)
+		
+		// pipelines indexed by the pipeline_slot
+		sg_pipeline pipelines[PIPELINE_COUNT] = { 0 };
+
+		// Submission contexts of the threads that submitted primitives (see s_ctx)
+		std::vector<std::unique_ptr<submit_context>> submit_contexts;
+		std::mutex submit_contexts_mutex;
+		std::vector<u32> texture_remap_tmp; // context to frame texture slots (s_merge_submit_contexts)
+
+		// Sorting layers, the index is the render_sorting_layer id (the default layer is the first one)
+		std::vector<sorting_layer> sorting_layers;
+		std::mutex sorting_layers_mutex; // registration only, the layers are read without lock when submitting
+
+		// Draw commands of the frame, merged from the submission contexts (sorted and merged into batches in render_present)
+		std::vector<draw_cmd> draw_cmds;
+		std::vector<float> sort_values; // parallel to draw_cmds (see submit_context::sort_values)
+		std::vector<draw_cmd> draw_cmds_sort_tmp;
+		std::vector<draw_batch> draw_batches;
+
+		// Textures used in the frame, the index is the texture slot of the draw command key
+		std::vector<sg_image> textures;
+		std::unordered_map<u32 /* sg_image id */, u32> textures_slot;
+
+		// Vertex data in world space, uploaded once per frame (the cameras transform it in the vertex shader)
+		std::vector<vertex> vertex_data;
+
+		// Initial size of the streaming buffers (they grow when needed)
+		static constexpr std::size_t INITIAL_STREAM_BYTES_SIZE = 250000 * 4;
+		stream_buffer vertex_stream;
+
+		// Quads stream: 4 vertices per quad drawn with a static index buffer (0,1,2, 0,2,3 for each quad)
+		// The index buffer is recreated with the double of quads when the quads of the frame don't fit.
+		std::vector<vertex> quad_vertex_data;
+		stream_buffer quad_stream;
+		sg_buffer quad_ibo = { 0 };
+		i32 quad_ibo_quads = 0; // quads that the index buffer can draw
+
+		// Sprites stream: one sprite_instance per sprite, drawn as instances of the unit quad
+		std::vector<sprite_instance> sprite_instances;
+		stream_buffer sprite_stream;
+		sg_buffer unit_quad_vbo = { 0 };
+
+		// Lines stream: polylines expanded into triangles (6 vertices per segment)
+		std::vector<line_vertex> line_vertex_data;
+		stream_buffer line_stream;
+
+		// Retained layers, the index + 1 is the render_layer id (created and destroyed with the GPU acquired)
+		std::vector<std::unique_ptr<retained_layer>> layers;
+		std::vector<u32> layer_versions; // version of each slot, increased when its layer is destroyed
+		i32 max_layers = 0; // app_config::max_render_layers
+		static constexpr i32 LAYER_BUFFERS = 4; // quads, sprites, shapes and lines
+		static constexpr i32 ENGINE_BUFFERS = 64; // streams, index buffer and unit quad
+		std::vector<layer_draw> layer_draws; // layers submitted in the frame
+
+		// statistics of the frame being submitted, of the packet being drawn and of the last presented one
+		render_frame_stats frame_stats;
+		render_frame_stats draw_stats;
+		render_frame_stats last_frame_stats;
+		std::mutex stats_mutex; // the last frame stats are written by the render thread
+
+		// Textures released by the game threads, executed by the thread that draws the frames (see render_texture_release)
+		std::atomic<u64> frames_presented = 0;
+		std::vector<pending_release> releases;
+		std::mutex releases_mutex;
+		bool running = false; // between render_init and render_deinit, else the releases are executed immediately
+
+		// Shapes stream: one shape_instance per shape, drawn as instances of the unit quad
+		std::vector<shape_instance> shape_instances;
+		stream_buffer shape_stream;
 		
 		std::vector< camera_data > cameras;
+
+		// Virtual resolution (app_config::virtual_width and virtual_height): the cameras render to an offscreen
+		// target of this size that is upscaled to the window at the end of the frame. 0,0 renders to the window.
+		ivec2 virtual_size = { 0,0 };
+		bool virtual_integer_scale = true;
+
+		// Dynamic resolution (app_config::dynamic_resolution): the cameras render to the offscreen scene target with
+		// the window size multiplied by the scale, adjusted every DYNAMIC_RESOLUTION_FRAMES drawn frames from their GPU
+		// time (GL_TIME_ELAPSED queries around the frame passes, read back a few frames later without waiting).
+		// The target is allocated with the window size and the scaled scene is rendered in its bottom left corner.
+		static constexpr i32 DYNAMIC_RESOLUTION_FRAMES = 30;
+		static constexpr float DYNAMIC_RESOLUTION_STEP = 0.05f; // scale increase when there is time left
+		static constexpr i32 DYNAMIC_RESOLUTION_GROW_WINDOWS = 3; // consecutive windows with time left before growing
+		struct gpu_time_sample {
+			float miliseconds = 0;
+			float scale = 1.0f; // scale of the measured frame
+		};
+		struct {
+			bool enabled = false;
+			float target_miliseconds = 0;
+			float min_scale = 1.0f;
+			float scale = 1.0f;
+			std::vector<gpu_time_sample> samples; // written by the thread that draws (stats_mutex)
+			double accumulated_miliseconds = 0; // GPU time of the frames drawn with the current scale
+			i32 frames = 0;
+			i32 grow_windows = 0;
+		} dynamic_resolution;
+
+		// Ring of GPU timer queries, owned by the thread that draws the frames. The query of a frame is read when its
+		// result is available, the frames are not timed while all the queries are pending.
+		static constexpr i32 GPU_TIMER_QUERIES = 4;
+		struct {
+			GLuint queries[GPU_TIMER_QUERIES] = { 0 };
+			float scales[GPU_TIMER_QUERIES] = { 0 };
+			i32 first = 0; // oldest pending query
+			i32 pending = 0;
+		} gpu_timer;
+
+		// Offscreen scene target, created and resized by the thread that draws the frames
+		struct {
+			sg_image color = { 0 };
+			sg_image depth = { 0 }; // the pipelines are created for the default pass depth stencil format
+			sg_pass pass = { 0 };
+			ivec2 size = { 0,0 };
+		} scene_target;
+		sg_shader upscale_sh = { 0 };
+		sg_pipeline upscale_pip = { 0 };
+
+		// Frame packets (see packet_exchange), without render thread only the back one is used
+		frame_packet packets[3];
+		packet_exchange exchange;
+
+		// Optional render thread (app_config::render_thread). The GL context is current in the render thread only while
+		// it draws a packet, gpu_mutex serializes it with the GPU resources created from the game thread.
+		std::thread render_thread;
+		void* gl_context = nullptr;
+		std::mutex gpu_mutex;
 	};
 
 	static renderer_state g_rs; // renderer state
 
 
+	// Translucent pipelines test the depth written by the opaque pipelines in depth mode, without writing it
+	static void s_set_translucent_depth_state(sg_pipeline_desc* desc) {
+		desc->depth.compare = g_rs.depth_mode ? SG_COMPAREFUNC_LESS_EQUAL : SG_COMPAREFUNC_ALWAYS;
+		desc->depth.write_enabled = false;
+	}
+
 	void create_shaders_and_pipelines() {
 		sg_shader_desc sh_textured_desc = { 0 };
 		sh_textured_desc.fs.images[0] = { .name = "tex", .image_type = SG_IMAGETYPE_2D },
+		s_set_vs_params_desc(&sh_textured_desc);
 		sh_textured_desc.vs.source =
 			"#version 330\n"
 			"layout(location=0) in vec2 position;\n"
 			"layout(location=1) in vec4 color0;\n"
 			"layout(location=2) in vec2 texcoord0;\n"
+			"uniform mat4 view_proj;\n"
 			"out vec4 color;\n"
 			"out vec2 uv;"
 			"void main() {\n"
-			"  gl_Position = vec4(position,0,1);\n"
+			"  gl_Position = view_proj * vec4(position,0,1);\n"
 			"  color = color0;\n"
 			"  uv = texcoord0;\n"
 			"}\n";
@@ -133,14 +524,16 @@ namespace ds {
 
 		/* no textured shader */
 		sg_shader_desc sh_non_textured_desc = { 0 };
+		s_set_vs_params_desc(&sh_non_textured_desc);
 		sh_non_textured_desc.vs.source =
 			"#version 330\n"
 			"layout(location=0) in vec2 position;\n"
 			"layout(location=1) in vec4 color0;\n"
 			"layout(location=2) in vec2 texcoord;\n"
+			"uniform mat4 view_proj;\n"
 			"out vec4 color;\n"
 			"void main() {\n"
-			"  gl_Position = vec4(position,0,1);\n"
+			"  gl_Position = view_proj * vec4(position,0,1);\n"
 			"  color = color0;\n"
 			"}\n";
 		sh_non_textured_desc.fs.source =
@@ -157,24 +550,60 @@ namespace ds {
 		spipdesc.shader = g_rs.non_textured_sh;
 		spipdesc.label = "tris-non-textured-pipeline";
 		spipdesc.layout.attrs[0].format = SG_VERTEXFORMAT_FLOAT2;
-		spipdesc.layout.attrs[1].format = SG_VERTEXFORMAT_FLOAT4;
-		spipdesc.layout.attrs[2].format = SG_VERTEXFORMAT_FLOAT2;
+		spipdesc.layout.attrs[1].format = SG_VERTEXFORMAT_UBYTE4N;
+		spipdesc.layout.attrs[2].format = SG_VERTEXFORMAT_USHORT2N;
 		spipdesc.primitive_type = SG_PRIMITIVETYPE_TRIANGLES;
-		g_rs.tris_non_textured_pip = sg_make_pipeline(spipdesc);
+		s_set_translucent_depth_state(&spipdesc);
+		g_rs.pipelines[PIPELINE_TRIS] = sg_make_pipeline(spipdesc);
+
 
+		/* thick lines shader, pixel widths are converted to world units with the camera viewport size */
+		sg_shader_desc sh_lines_desc = { 0 };
+		s_set_vs_params_desc(&sh_lines_desc);
+		sh_lines_desc.vs.source =
+			"#version 330\n"
+			"layout(location=0) in vec2 position;\n"
+			"layout(location=1) in vec2 offset;\n"
+			"layout(location=2) in vec4 color0;\n"
+			"layout(location=3) in float half_width;\n"
+			"uniform mat4 view_proj;\n"
+			"uniform vec2 viewport_size;\n"
+			"out vec4 color;\n"
+			"void main() {\n"
+			"  float hw = half_width;\n"
+			"  if (hw < 0.0) {\n"
+			"    vec2 px_dir = (view_proj * vec4(1, 0, 0, 0)).xy * viewport_size * 0.5;\n"
+			"    hw = -hw / max(length(px_dir), 1e-6);\n"
+			"  }\n"
+			"  gl_Position = view_proj * vec4(position + offset * hw, 0, 1);\n"
+			"  color = color0;\n"
+			"}\n";
+		sh_lines_desc.fs.source = sh_non_textured_desc.fs.source;
+		g_rs.lines_sh = sg_make_shader(sh_lines_desc);
 
 		sg_pipeline_desc linespipdesc = { 0 };
-		linespipdesc.shader = g_rs.non_textured_sh;
+		linespipdesc.shader = g_rs.lines_sh;
 		linespipdesc.label = "lines-pipeline";
-		linespipdesc.layout.attrs[0].format = SG_VERTEXFORMAT_FLOAT2;
-		linespipdesc.layout.attrs[1].format = SG_VERTEXFORMAT_FLOAT4;
-		linespipdesc.layout.attrs[2].format = SG_VERTEXFORMAT_FLOAT2;
-		linespipdesc.primitive_type = SG_PRIMITIVETYPE_LINE_STRIP;
-		g_rs.lines_pip = sg_make_pipeline(linespipdesc);
+		linespipdesc.layout.attrs[0] = { .offset = offsetof(line_vertex, x), .format = SG_VERTEXFORMAT_FLOAT2 };
+		linespipdesc.layout.attrs[1] = { .offset = offsetof(line_vertex, offset_x), .format = SG_VERTEXFORMAT_FLOAT2 };
+		linespipdesc.layout.attrs[2] = { .offset = offsetof(line_vertex, color), .format = SG_VERTEXFORMAT_UBYTE4N };
+		linespipdesc.layout.attrs[3] = { .offset = offsetof(line_vertex, half_width), .format = SG_VERTEXFORMAT_FLOAT };
+		linespipdesc.layout.buffers[0].stride = sizeof(line_vertex);
+		linespipdesc.colors[0].blend = spipdesc.colors[0].blend;
+		linespipdesc.primitive_type = SG_PRIMITIVETYPE_TRIANGLES;
+		s_set_translucent_depth_state(&linespipdesc);
+		g_rs.pipelines[PIPELINE_LINES] = sg_make_pipeline(linespipdesc);
+
+		sg_pipeline_desc quads_pipdesc = spipdesc;
+		quads_pipdesc.label = "quads-pipeline";
+		quads_pipdesc.index_type = SG_INDEXTYPE_UINT32;
+		s_set_translucent_depth_state(&quads_pipdesc);
+		g_rs.pipelines[PIPELINE_QUADS] = sg_make_pipeline(quads_pipdesc);
 
 		sg_pipeline_desc tri_textured_pipdesc = { 0 };
 		tri_textured_pipdesc.shader = g_rs.textured_sh;
-		tri_textured_pipdesc.label = "tris-textured-pipeline";
+		tri_textured_pipdesc.label = "quads-textured-pipeline";
+		tri_textured_pipdesc.index_type = SG_INDEXTYPE_UINT32;
 		
 		// Default blending
 		tri_textured_pipdesc.colors[0].blend.enabled = true;
@@ -186,10 +615,158 @@ namespace ds {
 		tri_textured_pipdesc.colors[0].blend.op_alpha = SG_BLENDOP_ADD;
 
 		tri_textured_pipdesc.layout.attrs[0].format = SG_VERTEXFORMAT_FLOAT2;
-		tri_textured_pipdesc.layout.attrs[1].format = SG_VERTEXFORMAT_FLOAT4;
-		tri_textured_pipdesc.layout.attrs[2].format = SG_VERTEXFORMAT_FLOAT2;
+		tri_textured_pipdesc.layout.attrs[1].format = SG_VERTEXFORMAT_UBYTE4N;
+		tri_textured_pipdesc.layout.attrs[2].format = SG_VERTEXFORMAT_USHORT2N;
 		tri_textured_pipdesc.primitive_type = SG_PRIMITIVETYPE_TRIANGLES;
-		g_rs.tris_textured_pip = sg_make_pipeline(tri_textured_pipdesc);
+		s_set_translucent_depth_state(&tri_textured_pipdesc);
+		g_rs.pipelines[PIPELINE_QUADS_TEXTURED] = sg_make_pipeline(tri_textured_pipdesc);
+
+		/* instanced sprites shader, each instance expands the unit quad (buffer 0) */
+		sg_shader_desc sh_sprites_desc = { 0 };
+		sh_sprites_desc.fs.images[0] = { .name = "tex", .image_type = SG_IMAGETYPE_2D };
+		s_set_vs_params_desc(&sh_sprites_desc);
+		sh_sprites_desc.vs.source =
+			"#version 330\n"
+			"layout(location=0) in vec2 corner;\n"
+			"layout(location=1) in vec3 affine_x;\n"
+			"layout(location=2) in vec3 affine_y;\n"
+			"layout(location=3) in vec4 uv_rect;\n"
+			"layout(location=4) in vec4 color0;\n"
+			"uniform mat4 view_proj;\n"
+			"out vec4 color;\n"
+			"out vec2 uv;\n"
+			"void main() {\n"
+			"  vec3 p = vec3(corner, 1);\n"
+			"  gl_Position = view_proj * vec4(dot(affine_x, p), dot(affine_y, p), 0, 1);\n"
+			"  uv = mix(uv_rect.xy, uv_rect.zw, vec2(corner.x + 0.5, 0.5 - corner.y));\n"
+			"  color = color0;\n"
+			"}\n";
+		sh_sprites_desc.fs.source = sh_textured_desc.fs.source;
+		g_rs.sprites_sh = sg_make_shader(sh_sprites_desc);
+
+		sg_pipeline_desc sprites_pipdesc = { 0 };
+		sprites_pipdesc.shader = g_rs.sprites_sh;
+		sprites_pipdesc.label = "sprites-pipeline";
+		sprites_pipdesc.index_type = SG_INDEXTYPE_UINT32;
+		sprites_pipdesc.colors[0].blend = tri_textured_pipdesc.colors[0].blend;
+		sprites_pipdesc.layout.buffers[1].step_func = SG_VERTEXSTEP_PER_INSTANCE;
+		sprites_pipdesc.layout.attrs[0] = { .buffer_index = 0, .format = SG_VERTEXFORMAT_FLOAT2 };
+		sprites_pipdesc.layout.attrs[1] = { .buffer_index = 1, .offset = offsetof(sprite_instance, affine), .format = SG_VERTEXFORMAT_FLOAT3 };
+		sprites_pipdesc.layout.attrs[2] = { .buffer_index = 1, .offset = offsetof(sprite_instance, affine) + 3 * sizeof(float), .format = SG_VERTEXFORMAT_FLOAT3 };
+		sprites_pipdesc.layout.attrs[3] = { .buffer_index = 1, .offset = offsetof(sprite_instance, uv), .format = SG_VERTEXFORMAT_USHORT4N };
+		sprites_pipdesc.layout.attrs[4] = { .buffer_index = 1, .offset = offsetof(sprite_instance, color), .format = SG_VERTEXFORMAT_UBYTE4N };
+		sprites_pipdesc.layout.buffers[1].stride = sizeof(sprite_instance);
+		sprites_pipdesc.primitive_type = SG_PRIMITIVETYPE_TRIANGLES;
+		s_set_translucent_depth_state(&sprites_pipdesc);
+		g_rs.pipelines[PIPELINE_SPRITES] = sg_make_pipeline(sprites_pipdesc);
+
+		/* instanced sdf shapes shader, the unit quad is grown to leave room for the antialiasing */
+		sg_shader_desc sh_shapes_desc = { 0 };
+		s_set_vs_params_desc(&sh_shapes_desc);
+		sh_shapes_desc.vs.source =
+			"#version 330\n"
+			"layout(location=0) in vec2 corner;\n"
+			"layout(location=1) in vec3 affine_x;\n"
+			"layout(location=2) in vec3 affine_y;\n"
+			"layout(location=3) in vec4 shape0;\n"
+			"layout(location=4) in vec4 color0;\n"
+			"uniform mat4 view_proj;\n"
+			"uniform vec2 viewport_size;\n"
+			"out vec4 color;\n"
+			"out vec2 local_pos;\n"
+			"flat out vec4 shape;\n"
+			"void main() {\n"
+			"  vec2 px_dir = (view_proj * vec4(affine_x.x, affine_y.x, 0, 0)).xy * viewport_size * 0.5;\n"
+			"  float px = 1.0 / max(length(px_dir), 1e-6);\n" // local units per pixel
+			"  local_pos = corner * 2.0 * (shape0.xy + 2.0 * px);\n"
+			"  vec3 p = vec3(local_pos, 1);\n"
+			"  gl_Position = view_proj * vec4(dot(affine_x, p), dot(affine_y, p), 0, 1);\n"
+			"  color = color0;\n"
+			"  shape = shape0;\n"
+			"}\n";
+		sh_shapes_desc.fs.source =
+			"#version 330\n"
+			"in vec4 color;\n"
+			"in vec2 local_pos;\n"
+			"flat in vec4 shape;\n"
+			"out vec4 frag_color;\n"
+			"void main() {\n"
+			"  vec2 b = shape.xy;\n"
+			"  float r = min(shape.z, min(b.x, b.y));\n"
+			"  vec2 q = abs(local_pos) - b + r;\n"
+			"  float d = length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - r;\n" // rounded box signed distance
+			"  float px = max(length(vec2(dFdx(local_pos.x), dFdy(local_pos.x))), 1e-6);\n"
+			"  float t = shape.w < 0.0 ? -shape.w * px : shape.w;\n"
+			"  if (t > 0.0) { d = abs(d + 0.5 * t) - 0.5 * t; }\n" // outline inside the shape border
+			"  float alpha = clamp(0.5 - d / px, 0.0, 1.0);\n"
+			"  if (alpha <= 0.0) { discard; }\n"
+			"  frag_color = vec4(color.rgb, color.a * alpha);\n"
+			"}\n";
+		g_rs.shapes_sh = sg_make_shader(sh_shapes_desc);
+
+		sg_pipeline_desc shapes_pipdesc = sprites_pipdesc;
+		shapes_pipdesc.shader = g_rs.shapes_sh;
+		shapes_pipdesc.label = "shapes-pipeline";
+		shapes_pipdesc.layout.attrs[3] = { .buffer_index = 1, .offset = offsetof(shape_instance, half_size), .format = SG_VERTEXFORMAT_FLOAT4 };
+		shapes_pipdesc.layout.attrs[4] = { .buffer_index = 1, .offset = offsetof(shape_instance, color), .format = SG_VERTEXFORMAT_UBYTE4N };
+		shapes_pipdesc.layout.buffers[1].stride = sizeof(shape_instance);
+		s_set_translucent_depth_state(&shapes_pipdesc);
+		g_rs.pipelines[PIPELINE_SHAPES] = sg_make_pipeline(shapes_pipdesc);
+
+		/* opaque sprites shader, the transparent pixels are discarded and the rest written opaque with their depth */
+		sg_shader_desc sh_sprites_opaque_desc = sh_sprites_desc;
+		sh_sprites_opaque_desc.fs.source =
+			"#version 330\n"
+			"uniform sampler2D tex;\n"
+			"in vec4 color;\n"
+			"in vec2 uv;\n"
+			"out vec4 frag_color;\n"
+			"void main() {\n"
+			"  vec4 c = texture(tex, uv) * color;\n"
+			"  if (c.a < 0.5) { discard; }\n"
+			"  frag_color = vec4(c.rgb, 1.0);\n"
+			"}\n";
+		g_rs.sprites_opaque_sh = sg_make_shader(sh_sprites_opaque_desc);
+
+		sg_pipeline_desc sprites_opaque_pipdesc = sprites_pipdesc;
+		sprites_opaque_pipdesc.shader = g_rs.sprites_opaque_sh;
+		sprites_opaque_pipdesc.label = "sprites-opaque-pipeline";
+		sprites_opaque_pipdesc.colors[0].blend = { 0 };
+		sprites_opaque_pipdesc.depth.compare = SG_COMPAREFUNC_LESS; // a sprite drawn later at the same depth is behind
+		sprites_opaque_pipdesc.depth.write_enabled = true;
+		g_rs.pipelines[PIPELINE_SPRITES_OPAQUE] = sg_make_pipeline(sprites_opaque_pipdesc);
+
+		/* upscale of the offscreen scene target to the window, the unit quad covers the viewport */
+		sg_shader_desc sh_upscale_desc = { 0 };
+		sh_upscale_desc.fs.images[0] = { .name = "tex", .image_type = SG_IMAGETYPE_2D };
+		sh_upscale_desc.vs.uniform_blocks[0].size = sizeof(upscale_params);
+		sh_upscale_desc.vs.uniform_blocks[0].uniforms[0] = { .name = "uv_scale", .type = SG_UNIFORMTYPE_FLOAT2 };
+		sh_upscale_desc.vs.source =
+			"#version 330\n"
+			"layout(location=0) in vec2 corner;\n"
+			"uniform vec2 uv_scale;\n"
+			"out vec2 uv;\n"
+			"void main() {\n"
+			"  gl_Position = vec4(corner * 2.0, 0, 1);\n"
+			"  uv = (corner + 0.5) * uv_scale;\n"
+			"}\n";
+		sh_upscale_desc.fs.source =
+			"#version 330\n"
+			"uniform sampler2D tex;\n"
+			"in vec2 uv;\n"
+			"out vec4 frag_color;\n"
+			"void main() {\n"
+			"  frag_color = texture(tex, uv);\n"
+			"}\n";
+		g_rs.upscale_sh = sg_make_shader(sh_upscale_desc);
+
+		sg_pipeline_desc upscale_pipdesc = { 0 };
+		upscale_pipdesc.shader = g_rs.upscale_sh;
+		upscale_pipdesc.label = "upscale-pipeline";
+		upscale_pipdesc.index_type = SG_INDEXTYPE_UINT32;
+		upscale_pipdesc.layout.attrs[0] = { .format = SG_VERTEXFORMAT_FLOAT2 };
+		upscale_pipdesc.primitive_type = SG_PRIMITIVETYPE_TRIANGLES;
+		g_rs.upscale_pip = sg_make_pipeline(upscale_pipdesc);
 		
 
 	}
@@ -200,243 +777,1140 @@ namespace ds {
 	/// //////////////////////////////////////
 	
 
+	// Uploads the frame data to the next buffer of the ring, growing it if the data doesn't fit.
+	// After this stream->current and stream->offset point to the uploaded data.
+	template <typename T>
+	void s_stream_upload(stream_buffer* stream, const std::vector<T>& data) {
+		stream->ring_idx = (stream->ring_idx + 1) % stream_buffer::RING_SIZE;
+		const i32 idx = stream->ring_idx;
+		const size_t bytes = data.size() * sizeof(T);
+		stream->high_water_mark = std::max(stream->high_water_mark, bytes);
+		g_rs.draw_stats.vertices_uploaded += (i64)data.size();
+		g_rs.draw_stats.bytes_uploaded += (i64)bytes;
+		if (g_rs.headless) {
+			return;
+		}
+
+		if (bytes > stream->capacities[idx]) {
+			// grow geometrically, at least up to the high water mark
+			size_t new_capacity = std::max(stream->capacities[idx], (size_t)1);
+			while (new_capacity < stream->high_water_mark) {
+				new_capacity *= 2;
+			}
+			sg_destroy_buffer(stream->buffers[idx]);
+			stream->buffers[idx] = sg_make_buffer({ .size = new_capacity, .usage = SG_USAGE_STREAM, .label = stream->label });
+			stream->capacities[idx] = new_capacity;
+			stream->reallocations++;
+			DS_LOG(std::format("Stream buffer {} grown to {} bytes", stream->label, new_capacity));
+		}
+
+		stream->current = stream->buffers[idx];
+		stream->offset = 0;
+		if (bytes != 0) {
+			stream->offset = sg_append_buffer(stream->current, { data.data(), bytes });
+		}
+	}
+
+	void s_stream_init(stream_buffer* stream, const char* label, size_t initial_size) {
+		stream->label = label;
+		for (i32 i = 0; i < stream_buffer::RING_SIZE; i++) {
+			stream->buffers[i] = sg_make_buffer({ .size = initial_size, .usage = SG_USAGE_STREAM, .label = label });
+			stream->capacities[i] = initial_size;
+		}
+	}
+
+	// Makes sure that the quads index buffer can draw the number of quads (recreates it with the double of quads if not)
+	void s_ensure_quad_indices(i32 quads) {
+		if (g_rs.headless || quads <= g_rs.quad_ibo_quads) {
+			return;
+		}
+		i32 new_quads = std::max(g_rs.quad_ibo_quads, 1);
+		while (new_quads < quads) {
+			new_quads *= 2;
+		}
+
+		std::vector<u32> quad_indices(new_quads * 6);
+		for (u32 i = 0; i < (u32)new_quads; i++) {
+			const u32 v = i * 4;
+			const u32 quad[] = { v, v + 1, v + 2, v, v + 2, v + 3 };
+			std::copy(quad, quad + 6, quad_indices.begin() + i * 6);
+		}
+		sg_buffer_desc ibo_desc = { .type = SG_BUFFERTYPE_INDEXBUFFER, .usage = SG_USAGE_IMMUTABLE, .label = "quad-ibo" };
+		ibo_desc.data = { quad_indices.data(), quad_indices.size() * sizeof(u32) };
+		sg_destroy_buffer(g_rs.quad_ibo);
+		g_rs.quad_ibo = sg_make_buffer(ibo_desc);
+		g_rs.quad_ibo_quads = new_quads;
+	}
+
+	static void s_render_thread_main();
+	static void s_packet_publish();
+
+	// Executes a texture release, the GPU must be owned by the calling thread
+	static void s_execute_release(const pending_release& r) {
+		if (r.atlased) {
+			atlas_remove(r.atlas_slot);
+		} else if (r.image.id != 0 && sg_isvalid()) {
+			sg_destroy_image(r.image);
+		}
+	}
+
+	// Executes the releases queued before the drawn frame was presented
+	static void s_execute_releases(u64 drawn_frame) {
+		std::lock_guard<std::mutex> lock(g_rs.releases_mutex);
+		std::erase_if(g_rs.releases, [drawn_frame](const pending_release& r) {
+			if (r.frame > drawn_frame) {
+				return false;
+			}
+			s_execute_release(r);
+			return true;
+		});
+	}
+
 	void render_init() {
+		g_rs.running = true;
+		g_rs.headless = app_get_config().headless;
+		g_rs.max_layers = app_get_config().max_render_layers;
+		dsverifym(g_rs.max_layers > 0 && app_get_config().max_gpu_images > 0, "Invalid GPU resource budget.");
+		g_rs.depth_mode = app_get_config().depth_opaque_pass;
+		if (g_rs.sorting_layers.empty()) {
+			render_sorting_layer_register(RENDER_DEFAULT_SORTING_LAYER, render_sort_mode::depth, 0);
+		}
+		g_rs.virtual_size = { app_get_config().virtual_width, app_get_config().virtual_height };
+		g_rs.virtual_integer_scale = app_get_config().virtual_integer_scale;
+		dsverifym(g_rs.virtual_size.x >= 0 && g_rs.virtual_size.y >= 0, "Invalid virtual resolution.");
+		auto& dr = g_rs.dynamic_resolution;
+		dr.enabled = app_get_config().dynamic_resolution;
+		dr.target_miliseconds = app_get_config().dynamic_resolution_target_miliseconds;
+		dr.min_scale = std::clamp(app_get_config().dynamic_resolution_min_scale, 0.1f, 1.0f);
+		dsverifym(dr.target_miliseconds > 0, "Invalid dynamic resolution target frame time.");
+		if (dr.enabled && g_rs.virtual_size.x > 0 && g_rs.virtual_size.y > 0) {
+			DS_WARNING("Dynamic resolution is disabled with a virtual resolution.");
+			dr.enabled = false;
+		}
+		if (dr.enabled && g_rs.headless) {
+			DS_WARNING("Dynamic resolution is disabled in headless mode (there is no GPU time to measure).");
+			dr.enabled = false;
+		}
+		if (g_rs.headless) {
+			DS_LOG("Headless renderer: the primitives are batched but not drawn.");
+			ttf::ttf_init();
+			return;
+		}
+
 		// Create GL context
-		platform_backend::gl_context_create();
+		g_rs.gl_context = platform_backend::gl_context_create();
 
 		// Load GL functions
 		gladLoadGL();
 
 		// Setup Sokol
 		sg_desc desc = { 0 };
-		desc.buffer_pool_size = 64;
-		desc.image_pool_size = 64;
+		desc.buffer_pool_size = g_rs.ENGINE_BUFFERS + g_rs.max_layers * g_rs.LAYER_BUFFERS;
+		desc.image_pool_size = app_get_config().max_gpu_images;
 		desc.pipeline_pool_size = 64;
 		sg_setup(desc);
 
-		// reserve the memory for this vector
-		g_rs.vertex_data.reserve(g_rs.MAX_VERTEX_DATA_BYTES_SIZE);
+		// create the streaming buffers updated each frame
+		s_stream_init(&g_rs.vertex_stream, "vertex-stream", g_rs.INITIAL_STREAM_BYTES_SIZE);
+		s_stream_init(&g_rs.quad_stream, "quad-vertex-stream", g_rs.INITIAL_STREAM_BYTES_SIZE);
+		s_stream_init(&g_rs.sprite_stream, "sprite-instances-stream", g_rs.INITIAL_STREAM_BYTES_SIZE);
+		s_stream_init(&g_rs.line_stream, "line-vertex-stream", g_rs.INITIAL_STREAM_BYTES_SIZE);
+		s_stream_init(&g_rs.shape_stream, "shape-instances-stream", g_rs.INITIAL_STREAM_BYTES_SIZE);
+		s_ensure_quad_indices((i32)(g_rs.INITIAL_STREAM_BYTES_SIZE / (4 * sizeof(vertex))));
 
-		// create the main Vertex Buffer Object that is update each frame
-		sg_buffer_desc buffer_desc = { .size = g_rs.MAX_VERTEX_DATA_BYTES_SIZE, .usage = SG_USAGE_STREAM, .label = "vertex-vbo" };
-		g_rs.vbo = sg_make_buffer(buffer_desc);
+		// the unit quad is drawn with the first quad of the index buffer
+		const float unit_quad[] = { -0.5f, 0.5f,	0.5f, 0.5f,		0.5f, -0.5f,	-0.5f, -0.5f };
+		sg_buffer_desc unit_quad_desc = { .usage = SG_USAGE_IMMUTABLE, .label = "unit-quad-vbo" };
+		unit_quad_desc.data = SG_RANGE(unit_quad);
+		g_rs.unit_quad_vbo = sg_make_buffer(unit_quad_desc);
 
 		// setup default pipelines
 		create_shaders_and_pipelines();
 
 		// initialized ttf
 		ttf::ttf_init();
+
+		// from now on the render thread makes the GL context current when drawing
+		if (app_get_config().render_thread) {
+			platform_backend::gl_context_make_current(nullptr);
+			g_rs.render_thread = std::thread(s_render_thread_main);
+		}
 	}
 
 	void render_deinit() {
+		if (g_rs.render_thread.joinable()) {
+			g_rs.packets[g_rs.exchange.back].quit = true;
+			s_packet_publish();
+			g_rs.render_thread.join();
+			platform_backend::gl_context_make_current(g_rs.gl_context);
+		}
+		// no frames in flight, release all the textures destroyed since the last drawn frame
+		s_execute_releases(UINT64_MAX);
+		g_rs.running = false;
 		ttf::ttf_deinit();
-		sg_shutdown();
+		atlas_deinit();
+		if (g_rs.gpu_timer.queries[0] != 0) {
+			glDeleteQueries(renderer_state::GPU_TIMER_QUERIES, g_rs.gpu_timer.queries);
+		}
+		if (!g_rs.headless) {
+			sg_shutdown();
+		}
 	}
 
-	// Returns the vertex data transformed by a projection and a view matrix
-	std::vector<float> s_transform_vertex_data(const mat3& projection, const mat3& view) {
-		const mat3 vp_mat = projection * view;
-		std::vector<float> transformed_vertex_data = g_rs.vertex_data;
-		for (size_t i = 0; i < transformed_vertex_data.size(); i = i + 8 /* vertex stride */) {
-			const vec3 vpos = vp_mat * vec3(transformed_vertex_data[i], transformed_vertex_data[i + 1], 1);
-			transformed_vertex_data[i] = vpos.x;
-			transformed_vertex_data[i + 1] = vpos.y;
+	// Layer being recorded by the thread (see render_layer_begin)
+	static thread_local retained_layer* t_recording_layer = nullptr;
+
+	// Returns the submission context of the calling thread (registered the first time the thread submits)
+	// or the context of the layer that the thread is recording.
+	static submit_context& s_ctx() {
+		if (t_recording_layer) {
+			return t_recording_layer->recording;
 		}
-		return transformed_vertex_data;
+		thread_local submit_context* ctx = nullptr;
+		if (!ctx) {
+			std::lock_guard<std::mutex> lock(g_rs.submit_contexts_mutex);
+			ctx = g_rs.submit_contexts.emplace_back(std::make_unique<submit_context>()).get();
+		}
+		return *ctx;
 	}
 
-	void s_gpu_upload_vertex_data(const std::vector<float>& vdata) {
-		// upload all the vertex data to the gpu
-		sg_range vbo_range;
-		vbo_range.ptr = vdata.data();
-		vbo_range.size = vdata.size() * sizeof(float) <= g_rs.MAX_VERTEX_DATA_BYTES_SIZE ? vdata.size() * sizeof(float) : g_rs.MAX_VERTEX_DATA_BYTES_SIZE;
-		if (vdata.size() * sizeof(float) > g_rs.MAX_VERTEX_DATA_BYTES_SIZE) {
-			DS_WARNING("Vertex data exceds the maximum VBO size, probably some primitives will be not rendered.");
+	// Sorting layer where the thread submits (see render_set_sorting_layer)
+	static thread_local u32 t_sorting_layer = 0;
+
+	// Adds a draw command for the vertices [vertex_start, vertex_start + vertex_count) of the context vertex data.
+	// The position is used by the y and custom sorting layers.
+	static void s_submit_draw(pipeline_slot pip, sg_image texture, i32 depth, vec2 position, i32 vertex_start, i32 vertex_count) {
+		submit_context& ctx = s_ctx();
+		const u64 submission = ctx.draw_cmds.size();
+		if (submission > DRAW_KEY_SUBMISSION_MASK) {
+			if (ctx.primitives_dropped++ == 0) {
+				DS_WARNING("Too many primitives submitted in a frame, the exceeding primitives will be not rendered.");
+			}
+			return;
+		}
+
+		// texture slot for this frame
+		u32 texture_slot = 0;
+		auto found = ctx.textures_slot.find(texture.id);
+		if (found != ctx.textures_slot.end()) {
+			texture_slot = found->second;
+		} else {
+			texture_slot = (u32)ctx.textures.size();
+			dsverifym(texture_slot <= 0xFFFF, "Too many textures used in a frame.");
+			ctx.textures_slot[texture.id] = texture_slot;
+			ctx.textures.push_back(texture);
 		}
 
-		// only update the buffer if it has data
-		if (vdata.size() != 0) {
-			//sg_append_buffer(g_rs.vbo, vbo_range);
-			sg_update_buffer(g_rs.vbo, vbo_range);
+		// depth is biased to keep the negative depths first when sorting.
+		// The y and custom sorting layers replace it with the quantized sort value in render_present (see s_resolve_sort_values)
+		const sorting_layer& sl = g_rs.sorting_layers[t_sorting_layer];
+		u64 biased_depth = 0;
+		float sort_value = 0;
+		switch (sl.mode) {
+		case render_sort_mode::none: break;
+		case render_sort_mode::depth: biased_depth = (u64)(std::clamp(depth, (i32)INT16_MIN, (i32)INT16_MAX) - INT16_MIN); break;
+		case render_sort_mode::y: sort_value = -position.y; break;
+		case render_sort_mode::custom: sort_value = sl.sort_key(position, depth); break;
 		}
+		u64 layer = sl.rank;
+		const u64 translucent = (pip != PIPELINE_SPRITES_OPAQUE);
+		if (!translucent) {
+			// opaque draws are sorted front to back
+			layer = 0xF - layer;
+			biased_depth = 0xFFFF - biased_depth;
+		}
+		draw_cmd cmd;
+		cmd.key = (translucent << DRAW_KEY_TRANSLUCENT_SHIFT) | (layer << DRAW_KEY_LAYER_SHIFT) | (biased_depth << DRAW_KEY_DEPTH_SHIFT) |
+			((u64)pip << DRAW_KEY_PIPELINE_SHIFT) | ((u64)texture_slot << DRAW_KEY_TEXTURE_SHIFT) | submission;
+		cmd.vertex_start = vertex_start;
+		cmd.vertex_count = vertex_count;
+		ctx.draw_cmds.push_back(cmd);
+		ctx.sort_values.push_back(sort_value);
 	}
 
-	void s_render_all_primitives(const mat3& projection, const mat3& view) {
-		auto vdata = s_transform_vertex_data(projection, view);
-		s_gpu_upload_vertex_data(vdata);
-		
-		for (auto& z : g_rs.render_list) {
-			//DS_LOG(std::format("Z : {}", z.first));
-			for (auto& pip : z.second) {
-				sg_apply_pipeline(sg_pipeline(pip.first));
-				for (auto& md : pip.second) {
-					sg_apply_bindings(md.bind);
-					//	sg_apply_uniforms(..) // this is optinal to update uniform data when using custom shaders
-					sg_draw(md.vertex_start, md.vertex_count, 1);
+	// Adds the 4 vertices of a quad (top left, top right, bottom right, bottom left) to the quads stream and submits it
+	static void s_submit_quad(pipeline_slot pip, sg_image texture, i32 depth, const vertex (&vertices)[4]) {
+		submit_context& ctx = s_ctx();
+		const i32 quad_idx = (i32)ctx.quad_vertex_data.size() / 4;
+		ctx.quad_vertex_data.insert(ctx.quad_vertex_data.end(), vertices, vertices + 4);
+		const vec2 center = 0.5f * vec2(vertices[0].x + vertices[2].x, vertices[0].y + vertices[2].y);
+		s_submit_draw(pip, texture, depth, center, quad_idx * 6, 6);
+	}
+
+	// Merges the submission contexts of all the threads into the frame data, the context draw commands are rebased to
+	// the frame vertex data and texture slots. The first context with primitives is moved instead of copied.
+	// At the same layer and depth the primitives of the contexts are drawn in the contexts registration order.
+	static void s_merge_submit_contexts() {
+		std::lock_guard<std::mutex> lock(g_rs.submit_contexts_mutex);
+		for (auto& ctx_ptr : g_rs.submit_contexts) {
+			submit_context& ctx = *ctx_ptr;
+			g_rs.frame_stats.primitives_dropped += ctx.primitives_dropped;
+			ctx.primitives_dropped = 0;
+			if (ctx.draw_cmds.empty()) {
+				continue;
+			}
+
+			if (g_rs.draw_cmds.empty()) {
+				// the frame data is empty (the buffers swapped in are the cleared frame ones)
+				g_rs.quad_vertex_data.swap(ctx.quad_vertex_data);
+				g_rs.sprite_instances.swap(ctx.sprite_instances);
+				g_rs.shape_instances.swap(ctx.shape_instances);
+				g_rs.line_vertex_data.swap(ctx.line_vertex_data);
+				g_rs.layer_draws.swap(ctx.layer_draws);
+				g_rs.draw_cmds.swap(ctx.draw_cmds);
+				g_rs.sort_values.swap(ctx.sort_values);
+				g_rs.textures.swap(ctx.textures);
+				g_rs.textures_slot.swap(ctx.textures_slot);
+				continue;
+			}
+
+			const i32 quads_offset = (i32)g_rs.quad_vertex_data.size() / 4 * 6;
+			const i32 sprites_offset = (i32)g_rs.sprite_instances.size();
+			const i32 shapes_offset = (i32)g_rs.shape_instances.size();
+			const i32 lines_offset = (i32)g_rs.line_vertex_data.size();
+			const i32 layer_draws_offset = (i32)g_rs.layer_draws.size();
+			g_rs.quad_vertex_data.insert(g_rs.quad_vertex_data.end(), ctx.quad_vertex_data.begin(), ctx.quad_vertex_data.end());
+			g_rs.sprite_instances.insert(g_rs.sprite_instances.end(), ctx.sprite_instances.begin(), ctx.sprite_instances.end());
+			g_rs.shape_instances.insert(g_rs.shape_instances.end(), ctx.shape_instances.begin(), ctx.shape_instances.end());
+			g_rs.line_vertex_data.insert(g_rs.line_vertex_data.end(), ctx.line_vertex_data.begin(), ctx.line_vertex_data.end());
+			g_rs.layer_draws.insert(g_rs.layer_draws.end(), ctx.layer_draws.begin(), ctx.layer_draws.end());
+
+			std::vector<u32>& texture_remap = g_rs.texture_remap_tmp;
+			texture_remap.resize(ctx.textures.size());
+			for (size_t i = 0; i < ctx.textures.size(); i++) {
+				const sg_image texture = ctx.textures[i];
+				auto found = g_rs.textures_slot.find(texture.id);
+				if (found != g_rs.textures_slot.end()) {
+					texture_remap[i] = found->second;
+				} else {
+					texture_remap[i] = (u32)g_rs.textures.size();
+					dsverifym(texture_remap[i] <= 0xFFFF, "Too many textures used in a frame.");
+					g_rs.textures_slot[texture.id] = texture_remap[i];
+					g_rs.textures.push_back(texture);
 				}
 			}
+
+			static constexpr u64 CMD_KEY_REBASED_BITS = (0xFFFFull << DRAW_KEY_TEXTURE_SHIFT) | DRAW_KEY_SUBMISSION_MASK;
+			for (size_t i = 0; i < ctx.draw_cmds.size(); i++) {
+				const u64 submission = g_rs.draw_cmds.size();
+				if (submission > DRAW_KEY_SUBMISSION_MASK) {
+					g_rs.frame_stats.primitives_dropped += (i32)(ctx.draw_cmds.size() - i);
+					DS_WARNING("Too many primitives submitted in a frame, the exceeding primitives will be not rendered.");
+					break;
+				}
+				draw_cmd cmd = ctx.draw_cmds[i];
+				const u32 pip = (u32)((cmd.key >> DRAW_KEY_PIPELINE_SHIFT) & 0xF);
+				const u32 tex = (u32)((cmd.key >> DRAW_KEY_TEXTURE_SHIFT) & 0xFFFF);
+				cmd.key = (cmd.key & ~CMD_KEY_REBASED_BITS) | ((u64)texture_remap[tex] << DRAW_KEY_TEXTURE_SHIFT) | submission;
+				switch (pip) {
+				case PIPELINE_QUADS:
+				case PIPELINE_QUADS_TEXTURED: cmd.vertex_start += quads_offset; break;
+				case PIPELINE_SPRITES:
+				case PIPELINE_SPRITES_OPAQUE: cmd.vertex_start += sprites_offset; break;
+				case PIPELINE_SHAPES: cmd.vertex_start += shapes_offset; break;
+				case PIPELINE_LINES: cmd.vertex_start += lines_offset; break;
+				case PIPELINE_RETAINED_LAYER: cmd.vertex_start += layer_draws_offset; break;
+				default: break;
+				}
+				g_rs.draw_cmds.push_back(cmd);
+				g_rs.sort_values.push_back(ctx.sort_values[i]);
+			}
+
+			ctx.quad_vertex_data.clear();
+			ctx.sprite_instances.clear();
+			ctx.shape_instances.clear();
+			ctx.line_vertex_data.clear();
+			ctx.layer_draws.clear();
+			ctx.draw_cmds.clear();
+			ctx.sort_values.clear();
+			ctx.textures.clear();
+			ctx.textures_slot.clear();
 		}
 	}
 
-	// Clears the entire screen
-	void s_render_clear_screen() {
+	// LSD radix sort of the draw commands by key (8 bits per pass, the passes where all the keys have the same byte are skipped)
+	static void s_sort_draw_cmds(std::vector<draw_cmd>& cmds, std::vector<draw_cmd>& tmp) {
+		const size_t count = cmds.size();
+		tmp.resize(count);
+		for (u32 pass = 0; pass < 8; pass++) {
+			const u32 shift = pass * 8;
+			size_t histogram[256] = { 0 };
+			for (size_t i = 0; i < count; i++) {
+				histogram[(cmds[i].key >> shift) & 0xFF]++;
+			}
+			if (histogram[(cmds[0].key >> shift) & 0xFF] == count) {
+				continue; // all the keys have the same byte
+			}
+
+			size_t offset = 0;
+			for (u32 i = 0; i < 256; i++) {
+				const size_t n = histogram[i];
+				histogram[i] = offset;
+				offset += n;
+			}
+			for (size_t i = 0; i < count; i++) {
+				tmp[histogram[(cmds[i].key >> shift) & 0xFF]++] = cmds[i];
+			}
+			cmds.swap(tmp);
+		}
+	}
 
+	// Writes the sort values of the draw commands in the y and custom sorting layers to the depth bits of their keys.
+	// The values are quantized to 16 bits in the range of the values of each layer (the full precision is used for
+	// the primitives of the frame, or of the retained layer).
+	static void s_resolve_sort_values(std::vector<draw_cmd>& cmds, const std::vector<float>& sort_values) {
+		float min_value[16];
+		float max_value[16];
+		bool sorted_by_value[16] = { false };
+		bool any = false;
+		for (const sorting_layer& sl : g_rs.sorting_layers) {
+			if (sl.mode == render_sort_mode::y || sl.mode == render_sort_mode::custom) {
+				sorted_by_value[sl.rank] = true;
+				min_value[sl.rank] = FLT_MAX;
+				max_value[sl.rank] = -FLT_MAX;
+				any = true;
+			}
+		}
+		if (!any) {
+			return;
+		}
+
+		// the opaque draws have the layer inverted (see s_submit_draw)
+		const auto cmd_rank = [](u64 key) {
+			const u32 layer = (u32)(key >> DRAW_KEY_LAYER_SHIFT) & 0xF;
+			return (key >> DRAW_KEY_TRANSLUCENT_SHIFT) ? layer : 0xF - layer;
+		};
+		for (size_t i = 0; i < cmds.size(); i++) {
+			const u32 rank = cmd_rank(cmds[i].key);
+			if (sorted_by_value[rank]) {
+				min_value[rank] = std::min(min_value[rank], sort_values[i]);
+				max_value[rank] = std::max(max_value[rank], sort_values[i]);
+			}
+		}
+		for (size_t i = 0; i < cmds.size(); i++) {
+			const u32 rank = cmd_rank(cmds[i].key);
+			if (!sorted_by_value[rank]) {
+				continue;
+			}
+			const float range = max_value[rank] - min_value[rank];
+			u64 quantized = range > 0 ? (u64)((sort_values[i] - min_value[rank]) / range * 65535.0f + 0.5f) : 0;
+			if (!(cmds[i].key >> DRAW_KEY_TRANSLUCENT_SHIFT)) {
+				quantized = 0xFFFF - quantized;
+			}
+			cmds[i].key = (cmds[i].key & ~(0xFFFFull << DRAW_KEY_DEPTH_SHIFT)) | (quantized << DRAW_KEY_DEPTH_SHIFT);
+		}
+	}
+
+	// Returns the layer and biased depth of the draw command key (not inverted for the opaque draws)
+	static inline u32 s_key_depth_index(u64 key) {
+		const u32 depth_index = (u32)(key >> DRAW_KEY_DEPTH_SHIFT) & DRAW_KEY_DEPTH_INDEX_MASK;
+		return (key >> DRAW_KEY_TRANSLUCENT_SHIFT) ? depth_index : DRAW_KEY_DEPTH_INDEX_MASK - depth_index;
+	}
+
+	// Clip space z of a depth rank (see s_rank_batch_depths), the higher layers and depths are closer to the camera.
+	// Only the depths used in the frame are spread over the depth range, so neighbouring depths don't share a depth
+	// buffer value (the full 20 bit depth index would be finer than the depth buffer precision).
+	static inline float s_depth_to_z(u32 depth_rank, u32 depth_count) {
+		return 1.0f - 2.0f * (float)(depth_rank + 1) / (float)(depth_count + 1);
+	}
+
+	// Replaces the depth index of the batches by its rank among the distinct depth indices of the frame
+	// Returns the number of distinct depths
+	static u32 s_rank_batch_depths(std::vector<draw_batch>& batches, std::vector<u32>& ranks) {
+		ranks.clear();
+		for (const draw_batch& b : batches) {
+			ranks.push_back(b.depth_index);
+		}
+		std::sort(ranks.begin(), ranks.end());
+		ranks.erase(std::unique(ranks.begin(), ranks.end()), ranks.end());
+		for (draw_batch& b : batches) {
+			b.depth_index = (u32)(std::lower_bound(ranks.begin(), ranks.end(), b.depth_index) - ranks.begin());
+		}
+		return (u32)ranks.size();
+	}
+
+	// Sorts the draw commands and merges the consecutive ones with the same state and contiguous vertices into batches.
+	// With split_depths the commands with different depths are not merged (each batch is drawn with its depth).
+	static void s_build_draw_batches(std::vector<draw_cmd>& cmds, std::vector<draw_cmd>& sort_tmp, std::vector<draw_batch>& batches, bool split_depths) {
+		batches.clear();
+		if (cmds.empty()) {
+			return;
+		}
+		s_sort_draw_cmds(cmds, sort_tmp);
+
+		for (const draw_cmd& cmd : cmds) {
+			const u32 pip = (u32)((cmd.key >> DRAW_KEY_PIPELINE_SHIFT) & 0xF);
+			const u32 tex = (u32)((cmd.key >> DRAW_KEY_TEXTURE_SHIFT) & 0xFFFF);
+			const u32 depth_index = s_key_depth_index(cmd.key);
+			if (!batches.empty()) {
+				draw_batch& last = batches.back();
+				const bool mergeable = (last.pipeline_slot == pip) && (last.texture_slot == tex) &&
+					(last.vertex_start + last.vertex_count == cmd.vertex_start) && (!split_depths || last.depth_index == depth_index);
+				if (mergeable) {
+					last.vertex_count += cmd.vertex_count;
+					continue;
+				}
+			}
+			batches.push_back({ .pipeline_slot = pip, .texture_slot = tex, .depth_index = depth_index, .vertex_start = cmd.vertex_start, .vertex_count = cmd.vertex_count });
+		}
+	}
+
+	// Draws a batch, the pipeline (and the uniforms) and the bindings are only applied when they change
+	static void s_draw_batch(const draw_batch& b, const batch_sources& src, const vs_params& params, u32* current_pip, u32* current_tex) {
+		if (b.pipeline_slot != *current_pip) {
+			sg_apply_pipeline(g_rs.pipelines[b.pipeline_slot]);
+			sg_apply_uniforms(SG_SHADERSTAGE_VS, 0, SG_RANGE(params));
+			*current_pip = b.pipeline_slot;
+			*current_tex = UINT32_MAX; // applying a pipeline resets the bindings
+			g_rs.draw_stats.pipeline_changes++;
+		}
+		if (s_is_sprites_pipeline(b.pipeline_slot) || b.pipeline_slot == PIPELINE_SHAPES) {
+			// there is no base instance in GL 3.3, the instance buffer offset selects the first instance
+			const bool sprites = s_is_sprites_pipeline(b.pipeline_slot);
+			const batch_sources::source& instances = sprites ? src.sprites : src.shapes;
+			const i32 instance_size = sprites ? (i32)sizeof(sprite_instance) : (i32)sizeof(shape_instance);
+			sg_bindings bind = { 0 };
+			bind.vertex_buffers[0] = g_rs.unit_quad_vbo;
+			bind.vertex_buffers[1] = instances.buffer;
+			bind.vertex_buffer_offsets[1] = instances.offset + b.vertex_start * instance_size;
+			bind.index_buffer = g_rs.quad_ibo;
+			bind.fs_images[0] = (*src.textures)[b.texture_slot];
+			sg_apply_bindings(bind);
+			*current_tex = UINT32_MAX;
+			sg_draw(0, 6, b.vertex_count);
+			g_rs.draw_stats.binding_changes++;
+			g_rs.draw_stats.draw_calls++;
+			return;
+		}
+		if (b.texture_slot != *current_tex) {
+			sg_bindings bind = { 0 };
+			const batch_sources::source& vertices = s_is_quads_pipeline(b.pipeline_slot) ? src.quads :
+				(b.pipeline_slot == PIPELINE_LINES) ? src.lines : src.tris;
+			bind.vertex_buffers[0] = vertices.buffer;
+			bind.vertex_buffer_offsets[0] = vertices.offset;
+			if (s_is_quads_pipeline(b.pipeline_slot)) {
+				bind.index_buffer = g_rs.quad_ibo;
+			}
+			bind.fs_images[0] = (*src.textures)[b.texture_slot];
+			sg_apply_bindings(bind);
+			*current_tex = b.texture_slot;
+			g_rs.draw_stats.binding_changes++;
+		}
+		sg_draw(b.vertex_start, b.vertex_count, 1);
+		g_rs.draw_stats.draw_calls++;
+	}
+
+	// Draws the retained layers [first, first + count) of the packet layer draws at the clip space z
+	static void s_render_layer_draws(const frame_packet& p, const camera_data& cam, i32 first, i32 count, float z) {
+		const mat3 view_proj = cam.projection_matrix * cam.view_matrix;
+		for (i32 i = first; i < first + count; i++) {
+			const layer_draw& ld = p.layer_draws[i];
+			const bool same_layer = ld.layer_idx < g_rs.layers.size() && g_rs.layer_versions[ld.layer_idx] == ld.version;
+			const retained_layer* layer = same_layer ? g_rs.layers[ld.layer_idx].get() : nullptr;
+			if (!layer) {
+				continue; // destroyed after the submission
+			}
+			vs_params params = { .view_proj = s_mat4_from_affine(view_proj * ld.model), .viewport_size = { cam.vp.z, cam.vp.w } };
+			params.view_proj[3][2] = z;
+			batch_sources src;
+			src.quads.buffer = layer->quads_vbo;
+			src.sprites.buffer = layer->sprites_vbo;
+			src.shapes.buffer = layer->shapes_vbo;
+			src.lines.buffer = layer->lines_vbo;
+			src.textures = &layer->textures;
+			u32 current_pip = PIPELINE_COUNT;
+			u32 current_tex = UINT32_MAX;
+			for (const draw_batch& b : layer->batches) {
+				s_draw_batch(b, src, params, &current_pip, &current_tex);
+			}
+		}
+	}
+
+	void s_render_all_primitives(const frame_packet& p, const camera_data& cam) {
+		vs_params params = { .view_proj = s_mat4_from_affine(cam.projection_matrix * cam.view_matrix), .viewport_size = { cam.vp.z, cam.vp.w } };
+		batch_sources src;
+		src.tris = { g_rs.vertex_stream.current, g_rs.vertex_stream.offset };
+		src.quads = { g_rs.quad_stream.current, g_rs.quad_stream.offset };
+		src.sprites = { g_rs.sprite_stream.current, g_rs.sprite_stream.offset };
+		src.shapes = { g_rs.shape_stream.current, g_rs.shape_stream.offset };
+		src.lines = { g_rs.line_stream.current, g_rs.line_stream.offset };
+		src.textures = &p.textures;
+
+		u32 current_pip = PIPELINE_COUNT;
+		u32 current_tex = UINT32_MAX;
+		u32 current_depth = UINT32_MAX;
+		for (const draw_batch& b : p.draw_batches) {
+			// in depth mode the batch depth is the z translation of the view projection
+			if (g_rs.depth_mode && b.depth_index != current_depth) {
+				current_depth = b.depth_index;
+				params.view_proj[3][2] = s_depth_to_z(current_depth, p.depth_count);
+				if (current_pip < PIPELINE_COUNT) {
+					sg_apply_uniforms(SG_SHADERSTAGE_VS, 0, SG_RANGE(params));
+				}
+			}
+			if (b.pipeline_slot == PIPELINE_RETAINED_LAYER) {
+				s_render_layer_draws(p, cam, b.vertex_start, b.vertex_count, params.view_proj[3][2]);
+				current_pip = PIPELINE_COUNT; // the layers change the pipeline and the uniforms
+				continue;
+			}
+			s_draw_batch(b, src, params, &current_pip, &current_tex);
+		}
+	}
+
+	// Size in pixels of the image where the cameras render: the virtual resolution or the window drawable size
+	// (multiplied by the dynamic resolution scale)
+	static ivec2 s_scene_size() {
+		if (g_rs.virtual_size.x > 0 && g_rs.virtual_size.y > 0) {
+			return g_rs.virtual_size;
+		}
 		ivec2 vp_size;
 		platform_backend::get_drawable_size(&vp_size.x, &vp_size.y);
+		if (g_rs.dynamic_resolution.enabled) {
+			vp_size = glm::max(ivec2(vec2(vp_size) * g_rs.dynamic_resolution.scale), ivec2(1));
+		}
+		return vp_size;
+	}
+
+	// Adjusts the dynamic resolution scale with the average GPU time of the last DYNAMIC_RESOLUTION_FRAMES frames drawn
+	// with the current scale (the samples of the frames drawn before a scale change are discarded).
+	// Over the target the scale is reduced in proportion (the GPU cost grows with the pixels, the square of the scale).
+	// The scale grows one step when the cost expected at the bigger scale stays under 90% of the target for
+	// DYNAMIC_RESOLUTION_GROW_WINDOWS consecutive windows, so it recovers without oscillating around the target.
+	static void s_update_dynamic_resolution() {
+		auto& dr = g_rs.dynamic_resolution;
+		if (!dr.enabled) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(g_rs.stats_mutex);
+			for (const renderer_state::gpu_time_sample& sample : dr.samples) {
+				if (sample.scale == dr.scale) {
+					dr.accumulated_miliseconds += sample.miliseconds;
+					dr.frames++;
+				}
+			}
+			dr.samples.clear();
+		}
+		if (dr.frames < renderer_state::DYNAMIC_RESOLUTION_FRAMES) {
+			return;
+		}
+		const float frame_miliseconds = (float)(dr.accumulated_miliseconds / dr.frames);
+		dr.accumulated_miliseconds = 0;
+		dr.frames = 0;
+
+		const float grown_scale = std::min(dr.scale + renderer_state::DYNAMIC_RESOLUTION_STEP, 1.0f);
+		const float grown_miliseconds = frame_miliseconds * (grown_scale * grown_scale) / (dr.scale * dr.scale);
+		if (frame_miliseconds > dr.target_miliseconds * 1.05f) {
+			dr.scale = std::max(dr.scale * std::sqrt(dr.target_miliseconds / frame_miliseconds), dr.min_scale);
+			dr.grow_windows = 0;
+		} else if (grown_scale > dr.scale && grown_miliseconds < dr.target_miliseconds * 0.9f) {
+			if (++dr.grow_windows >= renderer_state::DYNAMIC_RESOLUTION_GROW_WINDOWS) {
+				dr.scale = grown_scale;
+				dr.grow_windows = 0;
+			}
+		} else {
+			dr.grow_windows = 0;
+		}
+	}
+
+	// Recreates the offscreen scene target when its size changes
+	static void s_ensure_scene_target(ivec2 size) {
+		auto& target = g_rs.scene_target;
+		if (target.size == size && target.pass.id != 0) {
+			return;
+		}
+		sg_destroy_pass(target.pass);
+		sg_destroy_image(target.color);
+		sg_destroy_image(target.depth);
+
+		sg_image_desc image_desc = { 0 };
+		image_desc.render_target = true;
+		image_desc.width = size.x;
+		image_desc.height = size.y;
+		image_desc.pixel_format = SG_PIXELFORMAT_RGBA8;
+		// sharp pixels for the virtual resolution, smooth upscale for the dynamic resolution
+		image_desc.min_filter = g_rs.dynamic_resolution.enabled ? SG_FILTER_LINEAR : SG_FILTER_NEAREST;
+		image_desc.mag_filter = image_desc.min_filter;
+		image_desc.wrap_u = SG_WRAP_CLAMP_TO_EDGE;
+		image_desc.wrap_v = SG_WRAP_CLAMP_TO_EDGE;
+		image_desc.label = "scene-target-color";
+		target.color = sg_make_image(image_desc);
+		image_desc.pixel_format = SG_PIXELFORMAT_DEPTH_STENCIL;
+		image_desc.label = "scene-target-depth";
+		target.depth = sg_make_image(image_desc);
+
+		sg_pass_desc pass_desc = { 0 };
+		pass_desc.color_attachments[0].image = target.color;
+		pass_desc.depth_stencil_attachment.image = target.depth;
+		pass_desc.label = "scene-target-pass";
+		target.pass = sg_make_pass(pass_desc);
+		target.size = size;
+		DS_LOG(std::format("Scene target created with {}x{} pixels", size.x, size.y));
+	}
+
+	// Begins the pass of the image where the cameras render (the window or the offscreen scene target)
+	static void s_begin_scene_pass(const frame_packet& p, const sg_pass_action& pass_action) {
+		if (p.offscreen) {
+			sg_begin_pass(g_rs.scene_target.pass, &pass_action);
+		} else {
+			sg_begin_default_pass(&pass_action, p.scene_size.x, p.scene_size.y);
+		}
+	}
+
+	// Clears the entire screen
+	void s_render_clear_screen(const frame_packet& p) {
 		sg_pass_action pass_action = { 0 };
 		pass_action.colors[0] = { .action = SG_ACTION_CLEAR, .value = {0.3f, 0.3f, 0.3f, 1.0f } };
-		sg_begin_default_pass(&pass_action, vp_size.x, vp_size.y);
-		//sg_apply_viewport(0, 0, vp_size.x, vp_size.y, false);
-		//sg_apply_scissor_rect(0, 0, vp_size.x, vp_size.y, false);
+		s_begin_scene_pass(p, pass_action);
 		sg_end_pass();
+	}
 
-		
+	// Draws the offscreen scene target in the window. The virtual resolution is scaled by the biggest integer factor
+	// that fits (or keeping the aspect ratio with virtual_integer_scale disabled) and centered with black borders,
+	// the dynamic resolution covers the full window.
+	static void s_render_upscale(const frame_packet& p) {
+		ivec2 window_size;
+		platform_backend::get_drawable_size(&window_size.x, &window_size.y);
+		ivec2 size = window_size;
+		if (!g_rs.dynamic_resolution.enabled) {
+			const vec2 fit = vec2(window_size) / vec2(p.scene_size);
+			float scale = std::min(fit.x, fit.y);
+			if (g_rs.virtual_integer_scale) {
+				scale = std::max(std::floor(scale), 1.0f);
+			}
+			size = ivec2(vec2(p.scene_size) * scale);
+		}
+		const ivec2 origin = (window_size - size) / 2;
+		const upscale_params params = { .uv_scale = vec2(p.scene_size) / vec2(g_rs.scene_target.size) };
+
+		sg_pass_action pass_action = { 0 };
+		pass_action.colors[0] = { .action = SG_ACTION_CLEAR, .value = {0.0f, 0.0f, 0.0f, 1.0f } };
+		sg_begin_default_pass(&pass_action, window_size.x, window_size.y);
+		sg_apply_viewport(origin.x, origin.y, size.x, size.y, false);
+		sg_apply_pipeline(g_rs.upscale_pip);
+		sg_apply_uniforms(SG_SHADERSTAGE_VS, 0, SG_RANGE(params));
+		sg_bindings bind = { 0 };
+		bind.vertex_buffers[0] = g_rs.unit_quad_vbo;
+		bind.index_buffer = g_rs.quad_ibo;
+		bind.fs_images[0] = g_rs.scene_target.color;
+		sg_apply_bindings(bind);
+		sg_draw(0, 6, 1);
+		sg_end_pass();
+		g_rs.draw_stats.pipeline_changes++;
+		g_rs.draw_stats.binding_changes++;
+		g_rs.draw_stats.draw_calls++;
 	}
 
-	void s_render_camera(const camera_data& cam) {
-		// This sets a default pass (don't care = don't clear the screen)
-		ivec2 vp_size;
-		platform_backend::get_drawable_size(&vp_size.x, &vp_size.y);
+	void s_render_camera(const frame_packet& p, const camera_data& cam) {
+		// Keep the contents of the pass (don't clear the screen)
 		sg_pass_action pass_action = {0};
-		pass_action.colors[0] = { .action = SG_ACTION_DONTCARE };
-		sg_begin_default_pass(&pass_action, vp_size.x, vp_size.y);
+		pass_action.colors[0] = { .action = p.offscreen ? SG_ACTION_LOAD : SG_ACTION_DONTCARE };
+		s_begin_scene_pass(p, pass_action);
 
 		// Setup viewport and scissors for this camera
 		sg_apply_viewport(cam.vp.x, cam.vp.y, cam.vp.z, cam.vp.w, false);
 		sg_apply_scissor_rect(cam.scis.x, cam.scis.y, cam.scis.z, cam.scis.w, false);
 
+		// Clear the camera viewport drawing a clip space quad (the pass clear action clears the full screen)
+		if (cam.clear_color.a > 0) {
+			const vs_params identity = { .view_proj = glm::mat4(1.0f), .viewport_size = { cam.vp.z, cam.vp.w } };
+			sg_apply_pipeline(g_rs.pipelines[PIPELINE_TRIS]);
+			sg_apply_uniforms(SG_SHADERSTAGE_VS, 0, SG_RANGE(identity));
+			sg_bindings bind = { 0 };
+			bind.vertex_buffers[0] = g_rs.vertex_stream.current;
+			bind.vertex_buffer_offsets[0] = g_rs.vertex_stream.offset;
+			sg_apply_bindings(bind);
+			sg_draw(cam.clear_vertex_start, 6, 1);
+			g_rs.draw_stats.pipeline_changes++;
+			g_rs.draw_stats.binding_changes++;
+			g_rs.draw_stats.draw_calls++;
+		}
+
 		// Draw all the primitives with this projection and view matrices
-		s_render_all_primitives(cam.projection_matrix, cam.view_matrix);
+		s_render_all_primitives(p, cam);
 		sg_end_pass();
 	}
 
 
 
-	void s_render_all_cameras() {
+	// Orders the cameras and adds the vertices of the viewport clear quads to the vertex data (before the upload)
+	void s_prepare_cameras() {
 		if (g_rs.cameras.size() == 0) {
 			// If no camera added found, use a default camera with a ortho_width of 1 world unit
 			// and center it at 0,0
-			ivec2 vp_size;
-			platform_backend::get_drawable_size(&vp_size.x, &vp_size.y);
+			const ivec2 vp_size = s_scene_size();
 			const float aspect = vp_size.x / (float)vp_size.y;
-			const float ortho_width = 1.0f;
-			camera_data default_cam({0.f, 0.f, 1.f, 1.f }, mat3(1.0f), aspect, 1.0f);
-			s_render_camera(default_cam);
-		} else {
-			for (size_t i = 0; i < g_rs.cameras.size(); i++) {
-				s_render_camera(g_rs.cameras[i]);
+			g_rs.cameras.push_back(camera_data({ 0.f, 0.f, 1.f, 1.f }, mat3(1.0f), aspect, 1.0f, { 0, 0, 0, 0 }, 0, vp_size));
+		}
+
+		// lower order cameras are rendered first, same order keeps the submission order
+		std::stable_sort(g_rs.cameras.begin(), g_rs.cameras.end(), [](const camera_data& a, const camera_data& b) { return a.order < b.order; });
+
+		for (auto& cam : g_rs.cameras) {
+			if (cam.clear_color.a <= 0) {
+				continue;
 			}
+			const u32 c = s_pack_color(cam.clear_color);
+			const vertex vertices[] = {
+				s_make_vertex({ -1,  1 }, c), s_make_vertex({ 1,  1 }, c), s_make_vertex({ 1, -1 }, c),
+				s_make_vertex({ -1,  1 }, c), s_make_vertex({ 1, -1 }, c), s_make_vertex({ -1, -1 }, c)
+			};
+			cam.clear_vertex_start = (i32)g_rs.vertex_data.size();
+			g_rs.vertex_data.insert(g_rs.vertex_data.end(), vertices, vertices + 6);
 		}
 	}
 
-	void render_add_camera(const mat3& camera_ltw, vec4 camera_vp, float aspect, float ortho_width)	{
-		// TODO: we only support one camera for now
-		camera_data cd(camera_vp, camera_ltw, aspect, ortho_width);
-		if (g_rs.cameras.empty()) {
-			g_rs.cameras.push_back(cd);
-		} else {
-			// TODO: here we always use ONE camera..
-			g_rs.cameras[0] = cd;
+	void s_render_all_cameras(const frame_packet& p) {
+		for (size_t i = 0; i < p.cameras.size(); i++) {
+			s_render_camera(p, p.cameras[i]);
+		}
+	}
+
+	rect render_add_camera(const mat3& camera_ltw, vec4 camera_vp, float aspect, float ortho_width, vec4 clear_color, i32 order) {
+		g_rs.cameras.push_back(camera_data(camera_vp, camera_ltw, aspect, ortho_width, clear_color, order, s_scene_size()));
+		return g_rs.cameras.back().world_bounds;
+	}
+
+	std::vector<rect> render_get_cameras_bounds() {
+		std::vector<rect> bounds(g_rs.cameras.size());
+		for (size_t i = 0; i < g_rs.cameras.size(); i++) {
+			bounds[i] = g_rs.cameras[i].world_bounds;
 		}
+		return bounds;
 	}
 
 	// This flushes all the primitives and cameras
 	void s_render_clear() {
 		g_rs.vertex_data.clear();
-		g_rs.render_list.clear();
+		g_rs.quad_vertex_data.clear();
+		g_rs.sprite_instances.clear();
+		g_rs.shape_instances.clear();
+		g_rs.line_vertex_data.clear();
+		g_rs.layer_draws.clear();
+		g_rs.draw_cmds.clear();
+		g_rs.sort_values.clear();
+		g_rs.draw_batches.clear();
+		g_rs.textures.clear();
+		g_rs.textures_slot.clear();
 		g_rs.cameras.clear();
+		g_rs.frame_stats = {};
 	}
 
-	// This draws all the cameras 
-	void render_present() {
-		// start the frame by clearing the full screen
-		s_render_clear_screen();
-		// render all the primitives in all the cameras
-		s_render_all_cameras();
-		// ends the frame
-		sg_commit();
-		s_render_clear();
+	// Moves the submitted frame data to the packet (the packet old buffers are reused by the next frame)
+	static void s_packet_fill(frame_packet& p) {
+		p.vertex_data.swap(g_rs.vertex_data);
+		p.quad_vertex_data.swap(g_rs.quad_vertex_data);
+		p.sprite_instances.swap(g_rs.sprite_instances);
+		p.shape_instances.swap(g_rs.shape_instances);
+		p.line_vertex_data.swap(g_rs.line_vertex_data);
+		p.layer_draws.swap(g_rs.layer_draws);
+		p.draw_batches.swap(g_rs.draw_batches);
+		p.textures.swap(g_rs.textures);
+		p.cameras.swap(g_rs.cameras);
+		p.scene_size = s_scene_size();
+		p.offscreen = (g_rs.virtual_size.x > 0 && g_rs.virtual_size.y > 0) || g_rs.dynamic_resolution.enabled;
+		p.scene_target_size = p.scene_size;
+		if (g_rs.dynamic_resolution.enabled) {
+			platform_backend::get_drawable_size(&p.scene_target_size.x, &p.scene_target_size.y);
+		}
+		p.stats = g_rs.frame_stats;
+		p.stats.scene_scale = g_rs.dynamic_resolution.enabled ? g_rs.dynamic_resolution.scale : 1.0f;
+		p.frame = ++g_rs.frames_presented;
+		p.quit = false;
 	}
 
-	void render_line(const std::vector<vec2>& points, vec4 color, i32 depth) {
-		mesh_data md;
-		md.bind.vertex_buffers[0] = g_rs.vbo;
-		md.vertex_start = (int)g_rs.vertex_data.size() / 8;
-		md.vertex_count = (int)points.size();
+	// Publishes the back packet as the middle one and takes the previous middle one as the new back packet
+	static void s_packet_publish() {
+		packet_exchange& x = g_rs.exchange;
+		x.back = x.middle.exchange(x.back | packet_exchange::NEW_BIT) & packet_exchange::INDEX_MASK;
+		x.middle.notify_one();
+	}
 
-		// fill vertex data
-		for (auto& p : points) {
-			g_rs.vertex_data.push_back(p.x);
-			g_rs.vertex_data.push_back(p.y);
-			g_rs.vertex_data.push_back(color.r);
-			g_rs.vertex_data.push_back(color.g);
-			g_rs.vertex_data.push_back(color.b);
-			g_rs.vertex_data.push_back(color.a);
-			g_rs.vertex_data.push_back(0);
-			g_rs.vertex_data.push_back(0);
+	// Waits for a new middle packet and takes it as the front packet
+	static const frame_packet& s_packet_take() {
+		packet_exchange& x = g_rs.exchange;
+		u32 middle = x.middle.load();
+		while (!(middle & packet_exchange::NEW_BIT)) {
+			x.middle.wait(middle);
+			middle = x.middle.load();
 		}
+		x.front = x.middle.exchange(x.front) & packet_exchange::INDEX_MASK;
+		return g_rs.packets[x.front];
+	}
 
-		// Add the primitive to the render list
-		g_rs.render_list[depth][g_rs.lines_pip.id].push_back(md);
+	// Starts timing the GPU commands of the frame, returns false if all the queries are still pending
+	static bool s_gpu_timer_begin(float scale) {
+		auto& gt = g_rs.gpu_timer;
+		if (gt.pending == renderer_state::GPU_TIMER_QUERIES) {
+			return false;
+		}
+		if (gt.queries[0] == 0) {
+			glGenQueries(renderer_state::GPU_TIMER_QUERIES, gt.queries);
+		}
+		const i32 slot = (gt.first + gt.pending) % renderer_state::GPU_TIMER_QUERIES;
+		gt.scales[slot] = scale;
+		glBeginQuery(GL_TIME_ELAPSED, gt.queries[slot]);
+		return true;
 	}
 
-	void render_circle(vec2 center, float radius, vec4 color, i32 depth) {
-		const i32 segments = 24;
-		const float increment = glm::two_pi<float>() / segments;
+	static void s_gpu_timer_end() {
+		glEndQuery(GL_TIME_ELAPSED);
+		g_rs.gpu_timer.pending++;
+	}
+
+	// Reads the available results of the pending queries (oldest first) into the dynamic resolution samples
+	// Returns the GPU time of the most recent one (or -1 if none is available)
+	static double s_gpu_timer_read() {
+		auto& gt = g_rs.gpu_timer;
+		double last_miliseconds = -1;
+		while (gt.pending > 0) {
+			const GLuint query = gt.queries[gt.first];
+			GLint available = 0;
+			glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				break;
+			}
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+			last_miliseconds = (double)nanoseconds / 1000000.0;
+			g_rs.dynamic_resolution.samples.push_back({ .miliseconds = (float)last_miliseconds, .scale = gt.scales[gt.first] });
+			gt.first = (gt.first + 1) % renderer_state::GPU_TIMER_QUERIES;
+			gt.pending--;
+		}
+		return last_miliseconds;
+	}
+
+	// Uploads and draws a frame packet in all its cameras
+	static void s_render_packet(const frame_packet& p) {
+		render_frame_stats& stats = g_rs.draw_stats;
+		stats = p.stats;
+
+		const double upload_start = platform_backend::get_performance_counter_miliseconds();
+		atlas_flush();
+		s_stream_upload(&g_rs.vertex_stream, p.vertex_data);
+		s_stream_upload(&g_rs.quad_stream, p.quad_vertex_data);
+		s_stream_upload(&g_rs.sprite_stream, p.sprite_instances);
+		s_stream_upload(&g_rs.shape_stream, p.shape_instances);
+		s_stream_upload(&g_rs.line_stream, p.line_vertex_data);
+		s_ensure_quad_indices((i32)p.quad_vertex_data.size() / 4);
+		const double draw_start = platform_backend::get_performance_counter_miliseconds();
+		const bool gpu_timed = !g_rs.headless && g_rs.dynamic_resolution.enabled && s_gpu_timer_begin(p.stats.scene_scale);
+		if (!g_rs.headless) {
+			if (p.offscreen) {
+				s_ensure_scene_target(p.scene_target_size);
+			}
+			// start the frame by clearing the full screen
+			s_render_clear_screen(p);
+			// render all the primitives in all the cameras
+			s_render_all_cameras(p);
+			// present the offscreen scene in the window
+			if (p.offscreen) {
+				s_render_upscale(p);
+			}
+			// ends the frame
+			sg_commit();
+		}
+		if (gpu_timed) {
+			s_gpu_timer_end();
+		}
+		const double draw_end = platform_backend::get_performance_counter_miliseconds();
+		// the skipped packets are never drawn, the textures released until this frame are not used anymore
+		s_execute_releases(p.frame);
+
+		stats.upload_miliseconds = draw_start - upload_start;
+		stats.draw_miliseconds = draw_end - draw_start;
+		for (const stream_buffer* stream : { &g_rs.vertex_stream, &g_rs.quad_stream, &g_rs.sprite_stream, &g_rs.shape_stream, &g_rs.line_stream }) {
+			stats.stream_high_water_mark = std::max(stats.stream_high_water_mark, (i64)stream->high_water_mark);
+			stats.stream_reallocations += stream->reallocations;
+		}
+		std::lock_guard<std::mutex> lock(g_rs.stats_mutex);
+		if (g_rs.gpu_timer.pending > 0) {
+			stats.gpu_miliseconds = s_gpu_timer_read();
+		}
+		g_rs.last_frame_stats = stats;
+	}
 
-		std::vector<glm::vec2> per_pos; // perimeter positions
-		for (float currAngle = 0.0f; currAngle <= glm::two_pi<float>(); currAngle += increment) {
-			per_pos.push_back({center.x + radius * cos(currAngle), center.y + radius * sin(currAngle) });
+	static void s_render_thread_main() {
+		while (true) {
+			const frame_packet& p = s_packet_take();
+			if (p.quit) {
+				break;
+			}
+			std::lock_guard<std::mutex> lock(g_rs.gpu_mutex);
+			platform_backend::gl_context_make_current(g_rs.gl_context);
+			s_render_packet(p);
+			platform_backend::swap_buffers();
+			platform_backend::gl_context_make_current(nullptr);
 		}
+	}
 
-		// close the line
-		per_pos.push_back(per_pos[0]);
-		render_line(per_pos, color, depth);
-		return;
+	// This draws all the cameras (or hands the frame to the render thread)
+	void render_present() {
+		// merge the primitives of all the threads and sort them, they are uploaded once for all the cameras
+		const double build_start = platform_backend::get_performance_counter_miliseconds();
+		s_merge_submit_contexts();
+		render_frame_stats& stats = g_rs.frame_stats;
+		stats.primitives_submitted = (i32)g_rs.draw_cmds.size() + stats.primitives_dropped;
+		s_resolve_sort_values(g_rs.draw_cmds, g_rs.sort_values);
+		s_build_draw_batches(g_rs.draw_cmds, g_rs.draw_cmds_sort_tmp, g_rs.draw_batches, g_rs.depth_mode);
+		const u32 depth_count = g_rs.depth_mode ? s_rank_batch_depths(g_rs.draw_batches, g_rs.depth_ranks) : 0;
+		s_prepare_cameras();
+		stats.draw_batches = (i32)g_rs.draw_batches.size();
+		stats.cameras = (i32)g_rs.cameras.size();
+		stats.build_miliseconds = platform_backend::get_performance_counter_miliseconds() - build_start;
+
+		frame_packet& p = g_rs.packets[g_rs.exchange.back];
+		s_packet_fill(p);
+		p.depth_count = depth_count;
+		s_render_clear();
+		s_update_dynamic_resolution(); // the cameras of the next frame use the new scale (from the frames drawn until now)
+		if (g_rs.render_thread.joinable()) {
+			s_packet_publish();
+		} else {
+			s_render_packet(p);
+		}
+	}
+
+	render_frame_stats render_get_frame_stats() {
+		std::lock_guard<std::mutex> lock(g_rs.stats_mutex);
+		return g_rs.last_frame_stats;
 	}
-	
-	void render_fill_circle(vec2 center, float radius , vec4 color, i32 depth) {
-		const i32 segments = 24;
-		const float increment = glm::two_pi<float>() / segments;
 
-		std::vector<glm::vec2> per_pos; // perimeter positions
-		for (float currAngle = 0.0f; currAngle <= glm::two_pi<float>(); currAngle += increment) {
-			per_pos.push_back({ center.x + radius * cos(currAngle), center.y + radius * sin(currAngle) });
+	void render_gpu_acquire() {
+		if (!g_rs.render_thread.joinable()) {
+			return;
 		}
+		g_rs.gpu_mutex.lock();
+		platform_backend::gl_context_make_current(g_rs.gl_context);
+	}
 
-		mesh_data md;
-		md.bind.vertex_buffers[0] = g_rs.vbo;
-		md.vertex_start = (int)g_rs.vertex_data.size() / 8;
-		md.vertex_count = 0;
+	void render_gpu_release() {
+		if (!g_rs.render_thread.joinable()) {
+			return;
+		}
+		platform_backend::gl_context_make_current(nullptr);
+		g_rs.gpu_mutex.unlock();
+	}
 
+	void render_texture_release(sg_image image, const atlas_region* atlas_slot) {
+		pending_release r = { .image = image, .atlas_slot = atlas_slot ? *atlas_slot : atlas_region(), .atlased = atlas_slot != nullptr };
+		std::unique_lock<std::mutex> lock(g_rs.releases_mutex);
+		if (!g_rs.running) {
+			lock.unlock();
+			s_execute_release(r);
+			return;
+		}
+		// the frame being submitted (not presented yet) can use the texture
+		r.frame = g_rs.frames_presented.load() + 1;
+		g_rs.releases.push_back(r);
+	}
 
-		// fill vertex data, all circle triangles minus one
-		for (size_t i = 0; i < (per_pos.size() - 1); i++) 			{
-			const float vertex[] = {
-				center.x, center.y,				color.r, color.g, color.b, color.a, 0,0,	//0
-				per_pos[i].x, per_pos[i].y,     color.r, color.g, color.b, color.a, 0,0,	//1
-				per_pos[i + 1].x, per_pos[i + 1].y,     color.r, color.g, color.b, color.a, 0,0		//2
-			};
-			md.vertex_count = md.vertex_count + 3;
-			g_rs.vertex_data.insert(g_rs.vertex_data.end(), vertex, vertex + (3 * 8));
+	void render_line(const std::vector<vec2>& points, vec4 color, i32 depth, float width) {
+		const i32 count = (i32)points.size();
+		if (count < 2) {
+			return;
 		}
 
-		// last triangle
-		const float vertex[] = {
-			// positions            colors
-			center.x, center.y,													color.r, color.g, color.b, color.a, 0,0,	//0
-			per_pos[per_pos.size() - 1].x, per_pos[per_pos.size() - 1].y,		color.r, color.g, color.b, color.a, 0,0,	//1
-			per_pos[0].x, per_pos[0].y,											color.r, color.g, color.b, color.a, 0,0		//2
+		// A polyline with the same first and last point is closed, the first point is joined instead of capped
+		const bool closed = (count > 2) && (points[0] == points[count - 1]);
+		const auto segment_dir = [&](i32 i) {
+			const vec2 d = points[i + 1] - points[i];
+			const float len = glm::length(d);
+			return len > 0 ? d / len : vec2(1, 0);
+		};
 
+		// left and right offsets of each point (in half width units)
+		static constexpr float MITER_LIMIT = 4.0f;
+		submit_context& ctx = s_ctx();
+		std::vector<vec2>& offsets = ctx.line_offsets_tmp;
+		offsets.resize(count * 2);
+		for (i32 i = 0; i < count; i++) {
+			const bool first = (i == 0);
+			const bool last = (i == count - 1);
+			if (!closed && (first || last)) {
+				// square caps
+				const vec2 d = first ? segment_dir(0) : segment_dir(count - 2);
+				const vec2 n = { -d.y, d.x };
+				const vec2 cap = first ? -d : d;
+				offsets[i * 2] = n + cap;
+				offsets[i * 2 + 1] = -n + cap;
+				continue;
+			}
+
+			// miter join between the previous and next segments
+			const vec2 d_prev = first || last ? segment_dir(count - 2) : segment_dir(i - 1);
+			const vec2 d_next = first || last ? segment_dir(0) : segment_dir(i);
+			const vec2 n_prev = { -d_prev.y, d_prev.x };
+			const vec2 n_next = { -d_next.y, d_next.x };
+			vec2 miter = n_prev + n_next;
+			const float miter_len = glm::length(miter);
+			miter = miter_len > 1e-4f ? miter / miter_len : n_prev;
+			const float scale = 1.0f / std::max(glm::dot(miter, n_prev), 1.0f / MITER_LIMIT);
+			offsets[i * 2] = miter * scale;
+			offsets[i * 2 + 1] = -miter * scale;
+		}
+
+		// two triangles per segment
+		const i32 vertex_start = (i32)ctx.line_vertex_data.size();
+		const u32 c = s_pack_color(color);
+		const float half_width = width * 0.5f;
+		const auto line_vtx = [&](i32 point, i32 side) {
+			const vec2& p = points[point];
+			const vec2& o = offsets[point * 2 + side];
+			return line_vertex{ .x = p.x, .y = p.y, .offset_x = o.x, .offset_y = o.y, .color = c, .half_width = half_width };
 		};
-		md.vertex_count = md.vertex_count + 3;
-		g_rs.vertex_data.insert(g_rs.vertex_data.end(), vertex, vertex + (3 * 8));
+		for (i32 i = 0; i < count - 1; i++) {
+			const line_vertex vertices[] = {
+				line_vtx(i, 0), line_vtx(i + 1, 0), line_vtx(i + 1, 1),
+				line_vtx(i, 0), line_vtx(i + 1, 1), line_vtx(i, 1)
+			};
+			ctx.line_vertex_data.insert(ctx.line_vertex_data.end(), vertices, vertices + 6);
+		}
 
 		// Add the primitive to the render list
-		g_rs.render_list[depth][g_rs.tris_non_textured_pip.id].push_back(md);
-		
+		s_submit_draw(PIPELINE_LINES, { 0 }, depth, points[0], vertex_start, (count - 1) * 6);
+	}
+
+	// Adds a shape instance with the local space (model) to the shapes stream and submits it
+	static void s_submit_shape(const mat3& model, vec2 half_size, float corner_radius, float thickness, vec4 color, i32 depth) {
+		submit_context& ctx = s_ctx();
+		const i32 instance_idx = (i32)ctx.shape_instances.size();
+		ctx.shape_instances.push_back({
+			.affine = { model[0].x, model[1].x, model[2].x, model[0].y, model[1].y, model[2].y },
+			.half_size = { half_size.x, half_size.y },
+			.corner_radius = corner_radius,
+			.thickness = thickness,
+			.color = s_pack_color(color),
+			.depth = (float)depth
+		});
+		s_submit_draw(PIPELINE_SHAPES, { 0 }, depth, model[2], instance_idx, 1);
+	}
+
+	void render_circle(vec2 center, float radius, vec4 color, i32 depth) {
+		render_ring(center, radius, -1.0f, color, depth);
 	}
 	
+	void render_fill_circle(vec2 center, float radius , vec4 color, i32 depth) {
+		s_submit_shape(glm::translate(mat3(1.0f), center), { radius, radius }, radius, 0.0f, color, depth);
+	}
+
+	void render_ring(vec2 center, float radius, float thickness, vec4 color, i32 depth) {
+		s_submit_shape(glm::translate(mat3(1.0f), center), { radius, radius }, radius, thickness, color, depth);
+	}
+
+	void render_capsule(vec2 a, vec2 b, float radius, vec4 color, i32 depth, float thickness) {
+		const vec2 ab = b - a;
+		const float len = glm::length(ab);
+		const vec2 dir = len > 0 ? ab / len : vec2(1, 0);
+		// local x axis goes from a to b
+		const mat3 model = mat3(vec3(dir.x, dir.y, 0), vec3(-dir.y, dir.x, 0), vec3((a + b) * 0.5f, 1));
+		s_submit_shape(model, { len * 0.5f + radius, radius }, radius, thickness, color, depth);
+	}
+
+	void render_rounded_rect(const mat3& model, vec2 size, float corner_radius, vec4 color, i32 depth, float thickness) {
+		s_submit_shape(model, size * 0.5f, corner_radius, thickness, color, depth);
+	}
+
 	void render_fill_rect(const mat3& tx, vec2 size, vec4 color, i32 depth) {
 		const vec2 half_size = size / 2.0f;
 		
@@ -447,30 +1921,17 @@ namespace ds {
 			tx * vec3{ -half_size.x, -half_size.y, 1 }
 		};
 
-		const float vertex[] = {
-			// positions            colors
-			positions[0].x, positions[0].y,     color.r, color.g, color.b, color.a, 0,0,	//0
-			positions[1].x, positions[1].y,     color.r, color.g, color.b, color.a, 0,0,	//1
-			positions[2].x, positions[2].y,     color.r, color.g, color.b, color.a, 0,0,	//2
-
-			positions[0].x, positions[0].y,     color.r, color.g, color.b, color.a, 0,0,	//0
-			positions[2].x, positions[2].y,     color.r, color.g, color.b, color.a, 0,0,	//2
-			positions[3].x, positions[3].y,     color.r, color.g, color.b, color.a, 0,0		//3
+		const u32 c = s_pack_color(color);
+		const vertex vertices[] = {
+			s_make_vertex(positions[0], c),	//0
+			s_make_vertex(positions[1], c),	//1
+			s_make_vertex(positions[2], c),	//2
+			s_make_vertex(positions[3], c)	//3
 		};
-
-		mesh_data md;
-		md.bind.vertex_buffers[0] = g_rs.vbo;
-		md.vertex_start = (int)g_rs.vertex_data.size() / 8;
-		md.vertex_count = 6;
-
-		// Add the primitive to the render list
-		g_rs.render_list[depth][g_rs.tris_non_textured_pip.id].push_back(md);
-
-		// Insert the vertex data to the vertex array
-		g_rs.vertex_data.insert(g_rs.vertex_data.end(), vertex, vertex + (6 * 8));
+		s_submit_quad(PIPELINE_QUADS, { 0 }, depth, vertices);
 	}
 
-	void render_rect(const mat3& tx, vec2 size, vec4 color, i32 depth) {
+	void render_rect(const mat3& tx, vec2 size, vec4 color, i32 depth, float width) {
 		const vec2 half_size = size / 2.0f;
 		const std::vector<glm::vec2> points {
 			tx * vec3{ -half_size.x, half_size.y, 1},
@@ -479,7 +1940,7 @@ namespace ds {
 			tx * vec3{ -half_size.x, -half_size.y, 1 },
 			tx * vec3{ -half_size.x, half_size.y, 1 }
 		};
-		render_line(points, color, depth);
+		render_line(points, color, depth, width);
 	}
 
 	// size world units (aqui tinc dubtes..)
@@ -529,31 +1990,201 @@ namespace ds {
 			tx * vec3{ -half_size.x, -half_size.y, 1 }
 		};
 
-		const float vertex[] = {
-			// positions            colors
-			positions[0].x, positions[0].y,     color.r, color.g, color.b, color.a, uv_rect.top_left().x, uv_rect.top_left().y,			//0
-			positions[1].x, positions[1].y,     color.r, color.g, color.b, color.a, uv_rect.top_right().x, uv_rect.top_right().y,		//1
-			positions[2].x, positions[2].y,     color.r, color.g, color.b, color.a, uv_rect.bottom_right().x, uv_rect.bottom_right().y,	//2
-
-			positions[0].x, positions[0].y,     color.r, color.g, color.b, color.a, uv_rect.top_left().x, uv_rect.top_left().y,			//0
-			positions[2].x, positions[2].y,     color.r, color.g, color.b, color.a, uv_rect.bottom_right().x, uv_rect.bottom_right().y,	//2
-			positions[3].x, positions[3].y,     color.r, color.g, color.b, color.a, uv_rect.bottom_left().x, uv_rect.bottom_left().y,	//3
+		const u32 c = s_pack_color(color);
+		const vertex vertices[] = {
+			s_make_vertex(positions[0], c, uv_rect.top_left()),		//0
+			s_make_vertex(positions[1], c, uv_rect.top_right()),	//1
+			s_make_vertex(positions[2], c, uv_rect.bottom_right()),	//2
+			s_make_vertex(positions[3], c, uv_rect.bottom_left())	//3
 		};
+		s_submit_quad(PIPELINE_QUADS_TEXTURED, texture, depth, vertices);
+	}
 
-		mesh_data md;
-		md.bind.vertex_buffers[0] = g_rs.vbo;
-		md.bind.fs_images[0] = texture;
-		md.vertex_start = (int)g_rs.vertex_data.size() / 8;
-		md.vertex_count = 6;
+	void render_sprite(const mat3& model, sg_image texture, rect uv_rect, vec4 color, i32 depth, bool opaque) {
+		submit_context& ctx = s_ctx();
+		const i32 instance_idx = (i32)ctx.sprite_instances.size();
+
+		const vec2 uv_tl = uv_rect.top_left();
+		const vec2 uv_br = uv_rect.bottom_right();
+		ctx.sprite_instances.push_back({
+			.affine = { model[0].x, model[1].x, model[2].x, model[0].y, model[1].y, model[2].y },
+			.uv = { s_pack_unorm16(uv_tl.x), s_pack_unorm16(uv_tl.y), s_pack_unorm16(uv_br.x), s_pack_unorm16(uv_br.y) },
+			.color = s_pack_color(color),
+			.depth = (float)depth
+		});
+		// the retained layers are drawn with a single depth, their sprites are always translucent
+		const bool opaque_pass = opaque && color.a >= 1.0f && g_rs.depth_mode && !t_recording_layer;
+		s_submit_draw(opaque_pass ? PIPELINE_SPRITES_OPAQUE : PIPELINE_SPRITES, texture, depth, model[2], instance_idx, 1);
+	}
 
+	static retained_layer* s_layer_get(render_layer layer) {
+		dsverifym(layer.id > 0 && layer.id <= g_rs.layers.size() && g_rs.layers[layer.id - 1] && g_rs.layer_versions[layer.id - 1] == layer.version, "Invalid render layer.");
+		return g_rs.layers[layer.id - 1].get();
+	}
 
-		// Add the primitive to the render list
-		g_rs.render_list[depth][g_rs.tris_textured_pip.id].push_back(md);
+	// Creates an immutable buffer with the data (or an invalid buffer if the data is empty or there is no GPU)
+	template <typename T>
+	static sg_buffer s_make_layer_buffer(const std::vector<T>& data, const char* label) {
+		if (data.empty() || g_rs.headless) {
+			return { 0 };
+		}
+		sg_buffer_desc desc = { .usage = SG_USAGE_IMMUTABLE, .label = label };
+		desc.data = { data.data(), data.size() * sizeof(T) };
+		const sg_buffer buf = sg_make_buffer(desc);
+		dsverifym(sg_query_buffer_state(buf) == SG_RESOURCESTATE_VALID, std::format("Can't create the render layer buffer {}, is app_config::max_render_layers exceeded?", label));
+		return buf;
+	}
+
+	static void s_layer_destroy_buffers(retained_layer* layer) {
+		if (g_rs.headless) {
+			return;
+		}
+		for (sg_buffer* buffer : { &layer->quads_vbo, &layer->sprites_vbo, &layer->shapes_vbo, &layer->lines_vbo }) {
+			if (buffer->id != 0) {
+				sg_destroy_buffer(*buffer);
+			}
+			*buffer = { 0 };
+		}
+	}
+
+	bool render_layer_try_create(render_layer* out_layer) {
+		dscheck(out_layer);
+		render_gpu_acquire();
+		u32 idx = 0;
+		while (idx < g_rs.layers.size() && g_rs.layers[idx]) {
+			idx++;
+		}
+		if (idx >= (u32)g_rs.max_layers) {
+			render_gpu_release();
+			return false;
+		}
+		if (idx == g_rs.layers.size()) {
+			g_rs.layers.emplace_back();
+			g_rs.layer_versions.push_back(0);
+		}
+		g_rs.layers[idx] = std::make_unique<retained_layer>();
+		*out_layer = { .id = idx + 1, .version = g_rs.layer_versions[idx] };
+		render_gpu_release();
+		return true;
+	}
 
-		// Insert the vertex data to the vertex array
-		g_rs.vertex_data.insert(g_rs.vertex_data.end(), vertex, vertex + (6 * 8));
+	render_layer render_layer_create() {
+		render_layer layer;
+		const bool created = render_layer_try_create(&layer);
+		dsverifym(created, "Too many render layers alive, destroy the unused ones or raise app_config::max_render_layers.");
+		return layer;
 	}
 
+	void render_layer_destroy(render_layer layer) {
+		render_gpu_acquire();
+		retained_layer* l = s_layer_get(layer);
+		s_layer_destroy_buffers(l);
+		g_rs.layers[layer.id - 1].reset();
+		g_rs.layer_versions[layer.id - 1]++;
+		render_gpu_release();
+	}
+
+	void render_layer_begin(render_layer layer) {
+		dsverifym(!t_recording_layer, "A render layer is already being recorded in this thread.");
+		retained_layer* l = s_layer_get(layer);
+		submit_context& rec = l->recording;
+		rec.quad_vertex_data.clear();
+		rec.sprite_instances.clear();
+		rec.shape_instances.clear();
+		rec.line_vertex_data.clear();
+		rec.draw_cmds.clear();
+		rec.sort_values.clear();
+		rec.textures.clear();
+		rec.textures_slot.clear();
+		rec.primitives_dropped = 0;
+		t_recording_layer = l;
+	}
 
+	void render_layer_end(render_layer layer) {
+		retained_layer* l = s_layer_get(layer);
+		dsverifym(t_recording_layer == l, "The render layer is not being recorded in this thread.");
+		t_recording_layer = nullptr;
+
+		submit_context& rec = l->recording;
+		std::vector<draw_batch> batches;
+		s_resolve_sort_values(rec.draw_cmds, rec.sort_values);
+		s_build_draw_batches(rec.draw_cmds, l->draw_cmds_sort_tmp, batches, false);
+
+		// the layer buffers can be in use by the render thread
+		render_gpu_acquire();
+		s_layer_destroy_buffers(l);
+		l->batches.swap(batches);
+		l->textures.swap(rec.textures);
+		l->quads_vbo = s_make_layer_buffer(rec.quad_vertex_data, "layer-quads-vbo");
+		l->sprites_vbo = s_make_layer_buffer(rec.sprite_instances, "layer-sprites-vbo");
+		l->shapes_vbo = s_make_layer_buffer(rec.shape_instances, "layer-shapes-vbo");
+		l->lines_vbo = s_make_layer_buffer(rec.line_vertex_data, "layer-lines-vbo");
+		s_ensure_quad_indices((i32)rec.quad_vertex_data.size() / 4);
+		l->dirty = false;
+		render_gpu_release();
+
+		// the recorded data is only needed to build the buffers
+		rec = submit_context();
+	}
+
+	void render_layer_set_dirty(render_layer layer) {
+		s_layer_get(layer)->dirty = true;
+	}
+
+	bool render_layer_is_dirty(render_layer layer) {
+		return s_layer_get(layer)->dirty;
+	}
+
+	void render_layer_submit(render_layer layer, const mat3& model, i32 depth) {
+		dsverifym(!t_recording_layer, "Render layers can't be submitted to other render layers.");
+		const retained_layer* l = s_layer_get(layer);
+		if (l->batches.empty()) {
+			return;
+		}
+		submit_context& ctx = s_ctx();
+		const i32 draw_idx = (i32)ctx.layer_draws.size();
+		ctx.layer_draws.push_back({ .layer_idx = layer.id - 1, .version = layer.version, .model = model });
+		s_submit_draw(PIPELINE_RETAINED_LAYER, { 0 }, depth, model[2], draw_idx, 1);
+	}
 
+	render_sorting_layer render_sorting_layer_register(const char* name, render_sort_mode mode, i32 order, float (*sort_key)(vec2 position, i32 depth)) {
+		std::lock_guard<std::mutex> lock(g_rs.sorting_layers_mutex);
+		dsverifym(name, "The sorting layer needs a name.");
+		dsverifym(mode != render_sort_mode::custom || sort_key, "The custom sorting layers need a sort key function.");
+		for (const sorting_layer& sl : g_rs.sorting_layers) {
+			dsverifym(sl.name != name, std::format("Sorting layer {} already registered.", name));
+		}
+		dsverifym(!g_rs.sorting_layers.empty() || std::string(name) == RENDER_DEFAULT_SORTING_LAYER, "The sorting layers must be registered after render_init.");
+		dsverifym(g_rs.sorting_layers.size() < 16, "Too many sorting layers (max 16).");
+		g_rs.sorting_layers.push_back({ .name = name, .mode = mode, .order = order, .sort_key = sort_key });
+
+		// the ranks follow the order, the layers with the same order keep the registration order
+		std::vector<u32> by_order(g_rs.sorting_layers.size());
+		for (u32 i = 0; i < by_order.size(); i++) {
+			by_order[i] = i;
+		}
+		std::stable_sort(by_order.begin(), by_order.end(), [](u32 a, u32 b) { return g_rs.sorting_layers[a].order < g_rs.sorting_layers[b].order; });
+		for (u32 rank = 0; rank < by_order.size(); rank++) {
+			g_rs.sorting_layers[by_order[rank]].rank = rank;
+		}
+		return { (u32)g_rs.sorting_layers.size() - 1 };
+	}
+
+	render_sorting_layer render_sorting_layer_get(const char* name) {
+		std::lock_guard<std::mutex> lock(g_rs.sorting_layers_mutex);
+		for (u32 i = 0; i < g_rs.sorting_layers.size(); i++) {
+			if (g_rs.sorting_layers[i].name == name) {
+				return { i };
+			}
+		}
+		DS_WARNING(std::format("Sorting layer {} not found, using the default one.", name));
+		return { 0 };
+	}
+
+	render_sorting_layer render_set_sorting_layer(render_sorting_layer layer) {
+		dsverifym(layer.id < g_rs.sorting_layers.size(), "Invalid sorting layer.");
+		const render_sorting_layer previous = { t_sorting_layer };
+		t_sorting_layer = layer.id;
+		return previous;
+	}
 }
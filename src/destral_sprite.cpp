@@ -2,6 +2,7 @@
 #include <destral/gfw/destral_gfw.h>
 #include <destral/destral_renderer.h>
 #include <destral/destral_app.h>
+#include <algorithm>
 
 namespace ds {
 	namespace cp {
@@ -45,9 +46,55 @@ namespace ds {
 				}
 			}
 
+			// Sprites are culled in batches: the world bounds of the sprites are gathered in SoA arrays and tested
+			// against all the cameras bounds with a branch free loop (vectorized by the compiler).
+			struct sprite_cull_batch {
+				static constexpr i32 SIZE = 256;
+				float min_x[SIZE];
+				float min_y[SIZE];
+				float max_x[SIZE];
+				float max_y[SIZE];
+				u8 visible[SIZE];
+				cp::sprite_renderer* sprite_renderers[SIZE];
+				cp::texture* textures[SIZE];
+				const mat3* ltws[SIZE];
+				i32 count = 0;
+			};
+
+			static void s_cull_and_render_batch(sprite_cull_batch* b, const std::vector<rect>& cameras_bounds) {
+				const i32 count = b->count;
+				if (cameras_bounds.empty()) {
+					// no cameras yet, the default camera is added at render_present
+					std::fill(b->visible, b->visible + count, (u8)1);
+				} else {
+					std::fill(b->visible, b->visible + count, (u8)0);
+					for (const rect& cam : cameras_bounds) {
+						for (i32 i = 0; i < count; i++) {
+							b->visible[i] |= (u8)((b->max_x[i] >= cam.min.x) & (b->min_x[i] <= cam.max.x) &
+								(b->max_y[i] >= cam.min.y) & (b->min_y[i] <= cam.max.y));
+						}
+					}
+				}
+
+				const render_sorting_layer previous_layer = render_set_sorting_layer({});
+				for (i32 i = 0; i < count; i++) {
+					if (b->visible[i]) {
+						// the frame uv rect is relative to the texture, remap it in case the texture is in an atlas page
+						cp::sprite_renderer* sr = b->sprite_renderers[i];
+						const cp::texture* tex = b->textures[i];
+						render_set_sorting_layer(sr->sorting_layer);
+						render_sprite(*b->ltws[i], tex->gpu_texid, tex->remap_uv(sr->get_current_uv_rect()), { 1,1,1,1 }, sr->depth, tex->is_opaque);
+					}
+				}
+				render_set_sorting_layer(previous_layer);
+				b->count = 0;
+			}
+
 			void render_sprites(registry* r) {
-				auto v = r->view_create({ cp::sprite_renderer::name, cp::hierarchy::name});
+				const std::vector<rect> cameras_bounds = render_get_cameras_bounds();
+				static sprite_cull_batch batch; // render_sprites only runs on the main thread
 
+				auto v = r->view_create({ cp::sprite_renderer::name, cp::hierarchy::name});
 				const auto hcp_idx = v.index(cp::hierarchy::name);
 				const auto srcp_idx = v.index(cp::sprite_renderer::name);
 				while (v.valid()) {
@@ -55,14 +102,27 @@ namespace ds {
 					auto texture_e = sr->get_current_texture_entity();
 					if (r->entity_valid(texture_e)) {
 						dsverify(r->entity_is_name(texture_e, en::texture::name));
-						auto texture_cp = r->component_get<cp::texture>(texture_e, cp::texture::name);
 						cp::hierarchy* h = v.data<cp::hierarchy>(hcp_idx);
-						render_texture(h->ltw(), texture_cp->gpu_texid, { 1, 1 }, sr->get_current_uv_rect() );
 
-						//DS_LOG(std::format("{}", sr->get_current_uv_rect()));
+						// world bounds of the sprite unit quad
+						const mat3& ltw = h->ltw();
+						const vec2 center = ltw[2];
+						const vec2 half_extents = 0.5f * vec2(glm::abs(ltw[0].x) + glm::abs(ltw[1].x), glm::abs(ltw[0].y) + glm::abs(ltw[1].y));
+						const i32 i = batch.count++;
+						batch.min_x[i] = center.x - half_extents.x;
+						batch.min_y[i] = center.y - half_extents.y;
+						batch.max_x[i] = center.x + half_extents.x;
+						batch.max_y[i] = center.y + half_extents.y;
+						batch.sprite_renderers[i] = sr;
+						batch.textures[i] = r->component_get<cp::texture>(texture_e, cp::texture::name);
+						batch.ltws[i] = &ltw;
+						if (batch.count == sprite_cull_batch::SIZE) {
+							s_cull_and_render_batch(&batch, cameras_bounds);
+						}
 					}
 					v.next();
 				}
+				s_cull_and_render_batch(&batch, cameras_bounds);
 			}
 		}
 	}
@@ -2,10 +2,14 @@
 #include <destral/destral_resource2.h>
 #include <destral/destral_renderer.h>
 #include <destral/destral_filesystem.h>
+#include <destral/destral_atlas.h>
 #include "thirdparty/stb_image.h"
 namespace ds {
 
 	static sg_image create_sg_image_from_memory(const u8* pixels_data, i32 width, i32 height) {
+		if (!sg_isvalid()) {
+			return { 0 }; // headless, there are no GPU images
+		}
 		sg_image_desc image_desc = { 0 };
 		image_desc.width = width;
 		image_desc.height = height;
@@ -17,39 +21,70 @@ namespace ds {
 		image_desc.wrap_w = SG_WRAP_CLAMP_TO_EDGE;
 		image_desc.data.subimage[0][0] = {
 			  .ptr = pixels_data,
-			  .size = sizeof(pixels_data)
+			  .size = (size_t)width * height * 4
 		};
 
 		//image_desc.label = "texture";
 		return sg_make_image(image_desc);
 	}
 
-	static sg_image create_sg_iamge_from_file(const std::string& filename) {
+	// Loads the image file into the texture, small textures are packed in the atlas pages
+	static bool load_texture_from_file(const std::string& filename, cp::texture* t) {
 		int x, y, n;
 		stbi_set_flip_vertically_on_load(true);
-		unsigned char* pixels = stbi_load(filename.c_str(), &x, &y, &n, 0);
-		if (pixels != nullptr) {
-			// ... process data if not null ...
-			// ... x = width, y = height, n = # 8-bit components per pixel ...
-			// ... replace '0' with '1'..'4' to force that many components per pixel
-			// ... but 'n' will always be the number that it would have been if you said 0
-			sg_image img = create_sg_image_from_memory(pixels, x, y);
-			stbi_image_free(pixels);
-			return img;
+		// force 4 components per pixel, the GPU images and the atlas pages are RGBA8
+		unsigned char* pixels = stbi_load(filename.c_str(), &x, &y, &n, 4);
+		if (pixels == nullptr) {
+			DS_WARNING(std::format("Error loading the image file: {}.", filename));
+			return false;
 		}
-		DS_WARNING(std::format("Error loading the image file: {}.", filename));
-		return { 0 };
+
+		t->size_px = { x, y };
+		t->is_opaque = true;
+		for (size_t i = 3; i < (size_t)x * y * 4; i += 4) {
+			if (pixels[i] != 0 && pixels[i] != 255) {
+				t->is_opaque = false;
+				break;
+			}
+		}
+
+		atlas_region region;
+		render_gpu_acquire();
+		if (atlas_add(pixels, t->size_px, &region)) {
+			t->gpu_texid = region.page;
+			t->atlas_uv_rect = region.uv_rect;
+			t->is_atlased = true;
+			t->atlas_slot = region;
+		} else {
+			t->gpu_texid = create_sg_image_from_memory(pixels, x, y);
+		}
+		render_gpu_release();
+		stbi_image_free(pixels);
+		return true;
 	}
 
 	///////////////////////
 
 	ivec2 cp::texture::get_size() {
-		sg_image_info info = sg_query_image_info(gpu_texid);
-		return { info.width, info.height };
+		return size_px;
+	}
+
+	cp::texture::texture(texture&& other) noexcept
+		: gpu_texid(other.gpu_texid), size_px(other.size_px), is_atlased(other.is_atlased), is_opaque(other.is_opaque),
+		atlas_uv_rect(other.atlas_uv_rect), atlas_slot(other.atlas_slot) {
+		other.gpu_texid = { .id = 0 };
+		other.is_atlased = false;
+		other.atlas_slot.page_idx = -1;
 	}
 
 	cp::texture::~texture() {
-		sg_destroy_image(gpu_texid);
+		// atlas pages are shared, they are destroyed with the atlas (only the texture space is released)
+		// the frames in flight can still draw the texture, the release is deferred until they are drawn
+		if (is_atlased && atlas_slot.page_idx >= 0) {
+			render_texture_release({ .id = 0 }, &atlas_slot);
+		} else if (gpu_texid.id != 0) {
+			render_texture_release(gpu_texid, nullptr);
+		}
 	}
 
 	void cp::texture::register_component(registry* r) {
@@ -73,11 +108,9 @@ namespace ds {
 		rl->load_fn = [](registry* r, const char* res_key_filepath) {
 			auto e = r->entity_make(en::texture::name);
 			cp::texture* t = r->component_get<cp::texture>(e, cp::texture::name);
-			sg_image gpu_img = create_sg_iamge_from_file(res_key_filepath);
-			if (gpu_img.id == 0) {
+			if (!load_texture_from_file(res_key_filepath, t)) {
 				return entity_null;
 			} else {
-				t->gpu_texid = gpu_img;
 				return e;
 			}
 		};
@@ -0,0 +1,215 @@
+#include <destral/destral_tilemap.h>
+#include <destral/destral_texture.h>
+#include <destral/gfw/destral_gfw.h>
+#include <cfloat>
+#include <algorithm>
+
+namespace ds {
+	namespace cp {
+		void tilemap::register_component(registry* r) {
+			r->component_register<tilemap>(tilemap::name, nullptr, tilemap::cleanup);
+		}
+
+		void tilemap::cleanup(registry* r, entity e, void* cp) {
+			tilemap* tm = (tilemap*)cp;
+			for (i32 i = 0; i < tm->_chunks.size(); i++) {
+				if (tm->_chunks[i].layer.id != 0) {
+					render_layer_destroy(tm->_chunks[i].layer);
+				}
+			}
+			tm->_chunks.clear();
+			tm->_cached_chunks = 0;
+		}
+
+		void tilemap::resize(ivec2 size_in_tiles) {
+			dsverify(size_in_tiles.x >= 0 && size_in_tiles.y >= 0);
+			for (i32 i = 0; i < _chunks.size(); i++) {
+				if (_chunks[i].layer.id != 0) {
+					render_layer_destroy(_chunks[i].layer);
+				}
+			}
+			_chunks.clear();
+			_cached_chunks = 0;
+			_size = size_in_tiles;
+			_chunks_count = (size_in_tiles + CHUNK_SIZE - 1) / CHUNK_SIZE;
+			_chunks.resize(_chunks_count.x * _chunks_count.y, chunk());
+		}
+
+		void tilemap::set_tile(ivec2 pos, u16 tile) {
+			dsverifym(pos.x >= 0 && pos.y >= 0 && pos.x < _size.x && pos.y < _size.y, "Tile position outside the tilemap.");
+			chunk& c = _chunks[(pos.y / CHUNK_SIZE) * _chunks_count.x + (pos.x / CHUNK_SIZE)];
+			u16& t = c.tiles[(pos.y % CHUNK_SIZE) * CHUNK_SIZE + (pos.x % CHUNK_SIZE)];
+			if (t != tile) {
+				t = tile;
+				c.dirty = true;
+			}
+		}
+
+		u16 tilemap::get_tile(ivec2 pos) const {
+			dsverifym(pos.x >= 0 && pos.y >= 0 && pos.x < _size.x && pos.y < _size.y, "Tile position outside the tilemap.");
+			const chunk& c = _chunks[(pos.y / CHUNK_SIZE) * _chunks_count.x + (pos.x / CHUNK_SIZE)];
+			return c.tiles[(pos.y % CHUNK_SIZE) * CHUNK_SIZE + (pos.x % CHUNK_SIZE)];
+		}
+
+		void tilemap::set_dirty() {
+			for (i32 i = 0; i < _chunks.size(); i++) {
+				_chunks[i].dirty = true;
+			}
+		}
+	}
+
+	namespace en {
+		namespace tilemap {
+			void register_entity(registry* r) {
+				r->entity_register(en::tilemap::name, { cp::tilemap::name, cp::hierarchy::name });
+			}
+
+			// Submits the tiles of the chunk, model is the chunk to world matrix (the chunk origin is its bottom left corner)
+			static void s_submit_chunk_tiles(cp::tilemap* tm, const cp::tilemap::chunk& c, ivec2 chunk_pos, cp::texture* tileset, const mat3& model, i32 depth) {
+				const ivec2 tileset_size_px = tileset->get_size();
+				const i32 tileset_columns = std::max(tileset_size_px.x / tm->tile_size_px.x, 1);
+				const vec2 tile_uv_size = vec2(tm->tile_size_px) / vec2(tileset_size_px);
+				const ivec2 first_tile = chunk_pos * cp::tilemap::CHUNK_SIZE;
+				for (i32 y = 0; y < cp::tilemap::CHUNK_SIZE && first_tile.y + y < tm->size().y; y++) {
+					for (i32 x = 0; x < cp::tilemap::CHUNK_SIZE && first_tile.x + x < tm->size().x; x++) {
+						const u16 tile = c.tiles[y * cp::tilemap::CHUNK_SIZE + x];
+						if (tile == cp::tilemap::TILE_EMPTY) {
+							continue;
+						}
+						// the tileset rows go from the top and the texture uvs from the bottom
+						const i32 column = (tile - 1) % tileset_columns;
+						const i32 row = (tile - 1) / tileset_columns;
+						const vec2 uv_min = { column * tile_uv_size.x, 1.0f - (row + 1) * tile_uv_size.y };
+						const rect uv = tileset->remap_uv(rect::from_size(uv_min, tile_uv_size));
+						const vec2 center = (vec2(x, y) + 0.5f) * tm->tile_size;
+						render_texture(glm::translate(model, center), tileset->gpu_texid, tm->tile_size, uv, { 1,1,1,1 }, depth);
+					}
+				}
+			}
+
+			// Records the tiles of the chunk in its layer, in the chunk local space
+			static void s_build_chunk(cp::tilemap* tm, cp::tilemap::chunk* c, ivec2 chunk_pos, cp::texture* tileset) {
+				render_layer_begin(c->layer);
+				s_submit_chunk_tiles(tm, *c, chunk_pos, tileset, mat3(1.0f), 0);
+				render_layer_end(c->layer);
+				c->dirty = false;
+			}
+
+			// Destroys the layers of the chunks not visible for longer until there are max_cached layers (the visible ones are kept)
+			static void s_evict_chunks(cp::tilemap* tm, i32 max_cached) {
+				if (tm->_cached_chunks <= max_cached) {
+					return;
+				}
+				std::vector<cp::tilemap::chunk*> hidden;
+				for (i32 i = 0; i < tm->_chunks.size(); i++) {
+					cp::tilemap::chunk& c = tm->_chunks[i];
+					if (c.layer.id != 0 && c.last_visible_frame != tm->_frame) {
+						hidden.push_back(&c);
+					}
+				}
+				const size_t count = std::min(hidden.size(), (size_t)(tm->_cached_chunks - max_cached));
+				std::partial_sort(hidden.begin(), hidden.begin() + count, hidden.end(), [](const cp::tilemap::chunk* a, const cp::tilemap::chunk* b) {
+					return a->last_visible_frame < b->last_visible_frame;
+				});
+				for (size_t i = 0; i < count; i++) {
+					render_layer_destroy(hidden[i]->layer);
+					hidden[i]->layer = {};
+					hidden[i]->dirty = true;
+				}
+				tm->_cached_chunks -= (i32)count;
+			}
+
+			// Adds the chunks inside the camera bounds (in world space) not added yet in this frame to visible
+			static void s_add_visible_chunks(cp::tilemap* tm, const mat3& wtl, rect bounds, std::vector<i32>* visible) {
+				vec2 local_min = { FLT_MAX, FLT_MAX };
+				vec2 local_max = { -FLT_MAX, -FLT_MAX };
+				for (const vec2& corner : { bounds.bottom_left(), bounds.bottom_right(), bounds.top_left(), bounds.top_right() }) {
+					const vec2 local = wtl * vec3(corner, 1);
+					local_min = glm::min(local_min, local);
+					local_max = glm::max(local_max, local);
+				}
+				const vec2 chunk_size = tm->tile_size * (float)cp::tilemap::CHUNK_SIZE;
+				const vec2 map_size = vec2(tm->size()) * tm->tile_size;
+				if (local_max.x < 0 || local_max.y < 0 || local_min.x > map_size.x || local_min.y > map_size.y) {
+					return;
+				}
+				const ivec2 first = glm::clamp(ivec2(glm::floor(local_min / chunk_size)), ivec2(0), tm->_chunks_count - 1);
+				const ivec2 last = glm::clamp(ivec2(glm::floor(local_max / chunk_size)), ivec2(0), tm->_chunks_count - 1);
+				for (i32 cy = first.y; cy <= last.y; cy++) {
+					for (i32 cx = first.x; cx <= last.x; cx++) {
+						const i32 idx = cy * tm->_chunks_count.x + cx;
+						if (tm->_chunks[idx].last_visible_frame != tm->_frame) {
+							tm->_chunks[idx].last_visible_frame = tm->_frame;
+							visible->push_back(idx);
+						}
+					}
+				}
+			}
+
+			void render_tilemaps(registry* r) {
+				const std::vector<rect> cameras_bounds = render_get_cameras_bounds();
+				if (cameras_bounds.empty()) {
+					return;
+				}
+
+				const render_sorting_layer previous_layer = render_set_sorting_layer({});
+				std::vector<i32> visible;
+				auto v = r->view_create({ cp::tilemap::name, cp::hierarchy::name });
+				const auto tm_idx = v.index(cp::tilemap::name);
+				const auto h_idx = v.index(cp::hierarchy::name);
+				while (v.valid()) {
+					cp::tilemap* tm = v.data<cp::tilemap>(tm_idx);
+					cp::hierarchy* h = v.data<cp::hierarchy>(h_idx);
+					cp::texture* tileset = r->entity_valid(tm->tileset) ? r->component_try_get<cp::texture>(tm->tileset, cp::texture::name) : nullptr;
+					if (!tileset || tm->_chunks.empty()) {
+						v.next();
+						continue;
+					}
+
+					// visible chunks of each camera (a single box around distant cameras would select the chunks between them)
+					const mat3& ltw = h->ltw();
+					const mat3 wtl = glm::inverse(ltw);
+					tm->_frame++;
+					visible.clear();
+					for (rect b : cameras_bounds) {
+						s_add_visible_chunks(tm, wtl, b, &visible);
+					}
+					if (visible.empty()) {
+						v.next();
+						continue;
+					}
+
+					// make room for the visible chunks without layer
+					i32 uncached = 0;
+					for (i32 idx : visible) {
+						uncached += tm->_chunks[idx].layer.id == 0 ? 1 : 0;
+					}
+					s_evict_chunks(tm, std::max(cp::tilemap::MAX_CACHED_CHUNKS - uncached, 0));
+
+					// the chunks that don't fit in the cache (or in the layers budget) are submitted tile by tile
+					render_set_sorting_layer(tm->sorting_layer);
+					const vec2 chunk_size = tm->tile_size * (float)cp::tilemap::CHUNK_SIZE;
+					for (i32 idx : visible) {
+						cp::tilemap::chunk& c = tm->_chunks[idx];
+						const ivec2 chunk_pos = { idx % tm->_chunks_count.x, idx / tm->_chunks_count.x };
+						const mat3 chunk_model = glm::translate(ltw, vec2(chunk_pos) * chunk_size);
+						if (c.layer.id == 0 && tm->_cached_chunks < cp::tilemap::MAX_CACHED_CHUNKS && render_layer_try_create(&c.layer)) {
+							tm->_cached_chunks++;
+							c.dirty = true;
+						}
+						if (c.layer.id == 0) {
+							s_submit_chunk_tiles(tm, c, chunk_pos, tileset, chunk_model, tm->depth);
+							continue;
+						}
+						if (c.dirty) {
+							s_build_chunk(tm, &c, chunk_pos, tileset);
+						}
+						render_layer_submit(c.layer, chunk_model, tm->depth);
+					}
+					v.next();
+				}
+				render_set_sorting_layer(previous_layer);
+			}
+		}
+	}
+}
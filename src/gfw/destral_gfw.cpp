@@ -24,7 +24,7 @@ namespace ds {
         while (v.valid()) {
             auto hr = v.data<cp::hierarchy>(hr_idx);
             auto cam = v.data<cp::camera>(cam_idx);
-            render_add_camera(hr->ltw(), cam->viewport, cam->aspect, cam->ortho_width);
+            cam->world_bounds = render_add_camera(hr->ltw(), cam->viewport, cam->aspect, cam->ortho_width, cam->clear_color, cam->order);
             v.next();
         }
     }